@@ -1,121 +1,1263 @@
-		#include <stdio.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
 
-int main() {
-	int pipe1 [2]; // Parent to child
-	int pipe2 [2]; // Child to parent
-	pid_t pid;
+#define SHM_RING_SIZE (1u << 20) // Bytes per direction in the shared-memory transport (power of two)
+#define MAX_WORKERS 64 // Upper bound for -P
+#define SHM_SPIN 2000 // Ring checks before a waiting side goes to sleep in the kernel (multi-core only)
+
+#define CHAN_PIPE 0 // Two pipes, as in the original assignment
+#define CHAN_SHM 1 // Two lock-free rings in a MAP_SHARED region
+
+#define CHAN_READY 1 // chan_wait: the channel can make progress
+#define EXTRA_READY 2 // chan_wait: the extra fd is readable
+
+// Every message in either direction is sent as a frame: this header followed by len payload bytes
+typedef struct {
+	uint32_t id; // Request ID, the child copies it into its response
+	uint32_t len; // Number of payload bytes after the header
+} FrameHeader;
+
+// Growable byte buffer that holds partial frames on either side of a channel
+typedef struct {
+	char *data; // Allocated storage
+	size_t start; // Offset of the first unconsumed byte
+	size_t end; // Offset one past the last stored byte
+	size_t cap; // Size of data
+} ByteBuf;
+
+// Single-producer/single-consumer byte ring. head and tail only grow, so head - tail is the fill level
+// Each index lives on its own cache line so the two processes don't bounce one line between cores
+typedef struct {
+	_Atomic uint64_t head; // Bytes ever written, only stored by the producer
+	char pad1[56];
+	_Atomic uint64_t tail; // Bytes ever read, only stored by the consumer
+	char pad2[56];
+	_Atomic uint32_t closed; // Set by the producer once it will write no more
+	char pad3[60];
+	char data[SHM_RING_SIZE];
+} ShmRing;
+
+// Eventcount a side sleeps on when its rings leave it nothing to do
+// The other side only pays for a futex wake when waiting is set
+typedef struct {
+	_Atomic uint32_t seq; // Futex word, bumped by whoever wakes the sleeper
+	_Atomic uint32_t waiting; // Nonzero while the owner is checking its rings or asleep
+	char pad[56];
+} Waiter;
+
+// Everything the parent and child share, created before fork()
+typedef struct {
+	ShmRing to_child;
+	ShmRing to_parent;
+	Waiter parent_wake;
+	Waiter child_wake;
+} ShmRegion;
 
-	// TODO : Create both pipes
-	// if ( pipe ( pipe1 ) == -1) { /* error handling */ }
+// One end of a parent/child connection. Both transports move the same framed byte stream
+typedef struct {
+	int kind; // CHAN_PIPE or CHAN_SHM
+	pid_t pid; // Parent side: the child's PID. Child side: the parent's PID
+	int is_parent; // Which end of the connection this is
+	int peer_gone; // The other process exited without closing (shm only, pipes report EOF themselves)
+	int reaped; // Parent side: chan_wait already collected the child with waitpid
+	int out_fd; // Pipe we write to
+	int in_fd; // Pipe we read from
+	ShmRegion *shm; // Mapping backing the rings
+	ShmRing *tx; // Ring we write to
+	ShmRing *rx; // Ring we read from
+	Waiter *self; // Where we sleep
+	Waiter *peer; // Where the other side sleeps
+} Channel;
 
-	if(pipe(pipe1) == -1){
-		perror("pipe1"); // Print message on error
+int shm_spin = SHM_SPIN; // Set to 0 on a single CPU, where spinning only delays the peer we wait for
+
+// Monotonic clock in nanoseconds
+uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Number of stored bytes not yet consumed
+size_t buf_used(const ByteBuf *b) {
+	return b->end - b->start;
+}
+
+// Makes room for at least extra more bytes after end
+int buf_reserve(ByteBuf *b, size_t extra) {
+	if(b->start == b->end) { // Empty, so rewind for free
+		b->start = b->end = 0;
+	}
+	if(b->end + extra <= b->cap) {
+		return 0;
+	}
+	if(b->start > 0) { // Slide unconsumed bytes to the front before growing
+		memmove(b->data, b->data + b->start, b->end - b->start);
+		b->end -= b->start;
+		b->start = 0;
+		if(b->end + extra <= b->cap) {
+			return 0;
+		}
+	}
+	size_t newcap = b->cap ? b->cap : 4096;
+	while(newcap < b->end + extra) {
+		newcap *= 2;
+	}
+	char *p = realloc(b->data, newcap);
+	if(p == NULL) {
+		return -1;
+	}
+	b->data = p;
+	b->cap = newcap;
+	return 0;
+}
+
+// Appends n bytes to the buffer
+int buf_append(ByteBuf *b, const void *src, size_t n) {
+	if(buf_reserve(b, n) == -1) {
+		return -1;
+	}
+	memcpy(b->data + b->end, src, n);
+	b->end += n;
+	return 0;
+}
+
+// Appends a complete frame (header + payload)
+int buf_append_frame(ByteBuf *b, uint32_t id, const void *payload, uint32_t len) {
+	FrameHeader hdr = { id, len };
+	if(buf_append(b, &hdr, sizeof(hdr)) == -1) {
+		return -1;
+	}
+	return buf_append(b, payload, len);
+}
+
+// Pops one complete frame if the buffer holds one. Returns 1 on success, 0 if more bytes are needed
+// payload points into the buffer and is only valid until the buffer is modified again
+int buf_next_frame(ByteBuf *b, FrameHeader *hdr, char **payload) {
+	if(buf_used(b) < sizeof(*hdr)) {
+		return 0;
+	}
+	memcpy(hdr, b->data + b->start, sizeof(*hdr));
+	if(buf_used(b) - sizeof(*hdr) < hdr->len) {
+		return 0;
+	}
+	*payload = b->data + b->start + sizeof(*hdr);
+	b->start += sizeof(*hdr) + hdr->len;
+	return 1;
+}
+
+// Reads whatever is available on fd into the buffer. Returns bytes read, 0 on EOF, -1 on error (errno EAGAIN if nothing was ready)
+ssize_t buf_fill(ByteBuf *b, int fd) {
+	if(buf_reserve(b, 65536) == -1) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ssize_t n;
+	do {
+		n = read(fd, b->data + b->end, b->cap - b->end);
+	} while(n == -1 && errno == EINTR);
+	if(n > 0) {
+		b->end += (size_t)n;
+	}
+	return n;
+}
+
+int set_nonblock(int fd) {
+	int flags = fcntl(fd, F_GETFL);
+	if(flags == -1) {
+		return -1;
+	}
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Raw futex calls on a word in the MAP_SHARED region (not FUTEX_PRIVATE, the peer is another process)
+void futex_wait(_Atomic uint32_t *addr, uint32_t val, long timeout_ms) {
+	struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000 };
+	syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+void futex_wake(_Atomic uint32_t *addr) {
+	syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Copies up to n bytes into the ring, returns how many fit
+size_t ring_write(ShmRing *r, const char *src, size_t n) {
+	uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	size_t space = SHM_RING_SIZE - (size_t)(head - tail);
+	if(n > space) {
+		n = space;
+	}
+	size_t off = (size_t)(head & (SHM_RING_SIZE - 1));
+	size_t first = n < SHM_RING_SIZE - off ? n : SHM_RING_SIZE - off; // Split the copy at the wrap point
+	memcpy(r->data + off, src, first);
+	memcpy(r->data, src + first, n - first);
+	atomic_store_explicit(&r->head, head + n, memory_order_release);
+	return n;
+}
+
+// Copies up to n bytes out of the ring, returns how many were available
+size_t ring_read(ShmRing *r, char *dst, size_t n) {
+	uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+	size_t avail = (size_t)(head - tail);
+	if(n > avail) {
+		n = avail;
+	}
+	size_t off = (size_t)(tail & (SHM_RING_SIZE - 1));
+	size_t first = n < SHM_RING_SIZE - off ? n : SHM_RING_SIZE - off;
+	memcpy(dst, r->data + off, first);
+	memcpy(dst + first, r->data, n - first);
+	atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+	return n;
+}
+
+// Wakes the other side if it is sleeping. The fence pairs with the one in chan_wait so that either
+// the sleeper sees our ring update or we see its waiting flag
+void waiter_notify(Waiter *w) {
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load_explicit(&w->waiting, memory_order_relaxed)) {
+		atomic_fetch_add(&w->seq, 1);
+		futex_wake(&w->seq);
+	}
+}
+
+// Nonblocking send. Returns bytes accepted, or -1 with errno EAGAIN when the channel is full
+ssize_t chan_write(Channel *ch, const char *src, size_t n) {
+	if(ch->kind == CHAN_PIPE) {
+		ssize_t w;
+		do {
+			w = write(ch->out_fd, src, n);
+		} while(w == -1 && errno == EINTR);
+		return w;
+	}
+	if(ch->peer_gone) {
+		errno = EPIPE;
+		return -1;
+	}
+	size_t w = ring_write(ch->tx, src, n);
+	if(w == 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+	waiter_notify(ch->peer);
+	return (ssize_t)w;
+}
+
+// Nonblocking receive. Returns bytes read, 0 at end of stream, or -1 with errno EAGAIN when nothing is ready
+ssize_t chan_read(Channel *ch, char *dst, size_t n) {
+	if(ch->kind == CHAN_PIPE) {
+		ssize_t r;
+		do {
+			r = read(ch->in_fd, dst, n);
+		} while(r == -1 && errno == EINTR);
+		return r;
+	}
+	size_t r = ring_read(ch->rx, dst, n);
+	if(r > 0) {
+		waiter_notify(ch->peer);
+		return (ssize_t)r;
+	}
+	if(atomic_load_explicit(&ch->rx->closed, memory_order_acquire) || ch->peer_gone) {
+		// closed is stored after the last byte, so one more look catches anything written just before it
+		r = ring_read(ch->rx, dst, n);
+		if(r > 0) {
+			return (ssize_t)r;
+		}
+		return 0;
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+// Tells the other side no more data is coming
+void chan_close_write(Channel *ch) {
+	if(ch->kind == CHAN_PIPE) {
+		if(ch->out_fd != -1) {
+			close(ch->out_fd);
+			ch->out_fd = -1;
+		}
+		return;
+	}
+	atomic_store_explicit(&ch->tx->closed, 1, memory_order_release);
+	waiter_notify(ch->peer);
+}
+
+// True when the rings let us read, see EOF, or (if want_write) write
+int shm_ready(Channel *ch, int want_read, int want_write) {
+	ShmRing *rx = ch->rx, *tx = ch->tx;
+	if(want_read && (atomic_load_explicit(&rx->head, memory_order_acquire) != atomic_load_explicit(&rx->tail, memory_order_relaxed) ||
+	                 atomic_load_explicit(&rx->closed, memory_order_acquire))) {
 		return 1;
 	}
-	if(pipe(pipe2) == -1){
-		perror("pipe2"); // Print message on error
+	if(want_write && atomic_load_explicit(&tx->head, memory_order_relaxed) - atomic_load_explicit(&tx->tail, memory_order_acquire) < SHM_RING_SIZE) {
 		return 1;
 	}
+	return 0;
+}
 
-	// TODO : Fork process
+// Notices a peer that died without closing its ring, so waits don't hang forever
+int shm_peer_alive(Channel *ch) {
+	if(ch->is_parent) {
+		if(!ch->reaped && waitpid(ch->pid, NULL, WNOHANG) == ch->pid) {
+			ch->reaped = 1;
+		}
+		return !ch->reaped;
+	}
+	return getppid() == ch->pid; // We were reparented, so the parent is gone
+}
 
-	pid = fork(); // (PID > 0) == Parent, (PID == 0) == Child
+// Blocks until the channel can be read (want_read) or written (want_write), or extra_fd (if not -1) is readable
+// Returns a mask of CHAN_READY and EXTRA_READY
+int chan_wait(Channel *ch, int want_read, int want_write, int extra_fd) {
+	if(ch->kind == CHAN_PIPE) {
+		struct pollfd pfd[3];
+		pfd[0].fd = want_read ? ch->in_fd : -1;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = want_write ? ch->out_fd : -1;
+		pfd[1].events = POLLOUT;
+		pfd[2].fd = extra_fd;
+		pfd[2].events = POLLIN;
+		for(int i = 0; i < 3; i++) {
+			pfd[i].revents = 0;
+		}
+		if(poll(pfd, 3, -1) == -1) {
+			return 0; // EINTR, caller just retries
+		}
+		return ((pfd[0].revents || pfd[1].revents) ? CHAN_READY : 0) | (pfd[2].revents ? EXTRA_READY : 0);
+	}
+
+	while(1) {
+		// Busy check briefly, a reply that is microseconds away isn't worth a futex round trip
+		for(int i = 0; i < shm_spin; i++) {
+			if(shm_ready(ch, want_read, want_write)) {
+				return CHAN_READY;
+			}
+		}
+		if(extra_fd != -1) {
+			struct pollfd pfd = { extra_fd, POLLIN, 0 };
+			if(poll(&pfd, 1, 0) > 0) {
+				return EXTRA_READY;
+			}
+		}
+
+		uint32_t seq = atomic_load(&ch->self->seq);
+		atomic_store_explicit(&ch->self->waiting, 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+		if(shm_ready(ch, want_read, want_write)) {
+			atomic_store(&ch->self->waiting, 0);
+			return CHAN_READY;
+		}
+		// Short timeouts let us poll extra_fd and notice a peer that crashed
+		futex_wait(&ch->self->seq, seq, extra_fd != -1 ? 10 : 100);
+		atomic_store(&ch->self->waiting, 0);
+
+		if(shm_ready(ch, want_read, want_write)) {
+			return CHAN_READY;
+		}
+		if(!shm_peer_alive(ch)) {
+			ch->peer_gone = 1;
+			return CHAN_READY; // Reads now report EOF and writes EPIPE
+		}
+	}
+}
+
+// Reads whatever the channel has into the buffer, same return convention as buf_fill
+ssize_t chan_fill(Channel *ch, ByteBuf *b) {
+	if(buf_reserve(b, 65536) == -1) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ssize_t n = chan_read(ch, b->data + b->end, b->cap - b->end);
+	if(n > 0) {
+		b->end += (size_t)n;
+	}
+	return n;
+}
+
+// Sends as much pending output as the channel accepts. Returns 0 when done or the channel is full, -1 on error
+int chan_flush(Channel *ch, ByteBuf *b) {
+	while(buf_used(b) > 0) {
+		ssize_t n = chan_write(ch, b->data + b->start, buf_used(b));
+		if(n == -1) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 0; // Channel is full, chan_wait will tell us when to continue
+			}
+			return -1;
+		}
+		b->start += (size_t)n;
+	}
+	return 0;
+}
+
+// Releases the parent's end and collects the child
+void chan_destroy(Channel *ch) {
+	chan_close_write(ch);
+	if(ch->kind == CHAN_PIPE) {
+		close(ch->in_fd);
+	}
+	if(ch->is_parent && !ch->reaped) {
+		waitpid(ch->pid, NULL, 0); // Wait for child to finish
+		ch->reaped = 1;
+	}
+	if(ch->kind == CHAN_SHM) {
+		munmap(ch->shm, sizeof(ShmRegion));
+	}
+}
+
+// Child side: answer every request frame with a response frame carrying the same ID
+// All frames that arrived in one read are answered with one write, so a full window costs two syscalls
+int run_child(Channel *ch) {
+	ByteBuf in = {0}, out = {0};
+	char prefix[64];
+	int prefix_len = snprintf(prefix, sizeof(prefix), "Child (pid %d) received: ", getpid());
+	int eof = 0;
+	int rc = 0;
+
+	while(!eof || buf_used(&out) > 0) {
+		int progress = 0;
+
+		if(!eof) {
+			ssize_t n = chan_fill(ch, &in);
+			if(n == 0) {
+				eof = 1; // Parent closed its write end
+			} else if(n > 0) {
+				progress = 1;
+			} else if(errno != EAGAIN) {
+				perror("read from parent");
+				rc = 1;
+				break;
+			}
+
+			FrameHeader hdr;
+			char *payload;
+			while(buf_next_frame(&in, &hdr, &payload) == 1) {
+				FrameHeader resp = { hdr.id, (uint32_t)prefix_len + hdr.len };
+				if(buf_append(&out, &resp, sizeof(resp)) == -1 ||
+				   buf_append(&out, prefix, (size_t)prefix_len) == -1 ||
+				   buf_append(&out, payload, hdr.len) == -1) {
+					perror("malloc");
+					rc = 1;
+					goto done;
+				}
+			}
+		}
+
+		if(buf_used(&out) > 0) {
+			size_t before = buf_used(&out);
+			if(chan_flush(ch, &out) == -1) {
+				perror("write to parent");
+				rc = 1;
+				break;
+			}
+			if(buf_used(&out) < before) {
+				progress = 1;
+			}
+		}
+
+		if(!progress && (!eof || buf_used(&out) > 0)) {
+			chan_wait(ch, !eof, buf_used(&out) > 0, -1);
+		}
+	}
+
+done:
+	chan_close_write(ch); // Closes pipes
+	free(in.data); // Free allocated memory
+	free(out.data);
+	return rc;
+}
+
+// Creates the transport, forks, and runs run_child in the child. ch receives the parent's end
+// parent_waiter (shm only, may be NULL) replaces the per-channel wakeup so one parent can sleep on many children
+// in_child (may be NULL) runs in the new child first, e.g. to close channels it inherited for other children
+int spawn_child(Channel *ch, int kind, Waiter *parent_waiter, void (*in_child)(void *), void *arg) {
+	int pipe1 [2]; // Parent to child
+	int pipe2 [2]; // Child to parent
+	ShmRegion *shm = NULL;
+
+	memset(ch, 0, sizeof(*ch));
+	ch->kind = kind;
+	ch->out_fd = ch->in_fd = -1;
+
+	if(kind == CHAN_PIPE) {
+		if(pipe(pipe1) == -1){
+			perror("pipe1"); // Print message on error
+			return -1;
+		}
+		if(pipe(pipe2) == -1){
+			perror("pipe2"); // Print message on error
+			close(pipe1[0]);
+			close(pipe1[1]);
+			return -1;
+		}
+	} else {
+		// Anonymous shared mapping: inherited by the child, zero-filled so the rings start empty
+		shm = mmap(NULL, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if(shm == MAP_FAILED) {
+			perror("mmap");
+			return -1;
+		}
+	}
+
+	pid_t parent = getpid();
+	fflush(stdout); // Otherwise the child would print our buffered output a second time
+	pid_t pid = fork(); // (PID > 0) == Parent, (PID == 0) == Child
 	if(pid == -1) {
 		perror("fork"); // Print message on error
-		return 1;
+		if(kind == CHAN_PIPE) {
+			close(pipe1[0]);
+			close(pipe1[1]);
+			close(pipe2[0]);
+			close(pipe2[1]);
+		} else {
+			munmap(shm, sizeof(ShmRegion));
+		}
+		return -1;
 	}
 
 	if (pid == 0) {
 		// Child process
-		// TODO : Close unused pipe ends
-		// close (pipe1 [1]) ; // Close write end of pipe1
-		// close (pipe2 [0]) ; // Close read end of pipe2
-
-		close(pipe1[1]); // Child doesn't write to pipe1
-		close(pipe2[0]); // Child doesn't read from pipe2
-
-		// Turns FDs into FILE* for easier I/O
-		FILE *from_parent = fdopen(pipe1[0], "r");
-		FILE *to_parent = fdopen(pipe2[1], "w");
-		if(!from_parent || !to_parent) {
-			perror("fdopen child"); // Print message on error
-			return 1;
+		if(in_child != NULL) {
+			in_child(arg);
 		}
+		ch->pid = parent;
+		if(kind == CHAN_PIPE) {
+			close(pipe1[1]); // Child doesn't write to pipe1
+			close(pipe2[0]); // Child doesn't read from pipe2
+			ch->in_fd = pipe1[0];
+			ch->out_fd = pipe2[1];
+			set_nonblock(ch->in_fd);
+			set_nonblock(ch->out_fd);
+		} else {
+			ch->shm = shm;
+			ch->tx = &shm->to_parent;
+			ch->rx = &shm->to_child;
+			ch->self = &shm->child_wake;
+			ch->peer = parent_waiter ? parent_waiter : &shm->parent_wake;
+		}
+		_exit(run_child(ch)); // _exit so inherited stdio buffers are not flushed twice
+	}
 
-		// TODO : Read from parent , send responses
+	// Parent process
+	ch->pid = pid;
+	ch->is_parent = 1;
+	if(kind == CHAN_PIPE) {
+		close(pipe1[0]); // Parent doesn't read from pipe1
+		close(pipe2[1]); // Parent doesn't write to pipe2
+		ch->out_fd = pipe1[1];
+		ch->in_fd = pipe2[0];
+		if(set_nonblock(ch->out_fd) == -1 || set_nonblock(ch->in_fd) == -1) {
+			perror("fcntl");
+			chan_destroy(ch);
+			return -1;
+		}
+	} else {
+		ch->shm = shm;
+		ch->tx = &shm->to_child;
+		ch->rx = &shm->to_parent;
+		ch->self = parent_waiter ? parent_waiter : &shm->parent_wake;
+		ch->peer = &shm->child_wake;
+	}
+	return 0;
+}
+
+
+// One pre-forked worker and the frames moving to and from it
+typedef struct {
+	Channel ch; // Parent's end of the connection
+	ByteBuf out; // Request frames the channel hasn't accepted yet
+	ByteBuf in; // Partial response frames
+	long in_flight; // Requests sent but not yet answered
+} Worker;
+
+// Book-keeping for one request from submission until its response is handed back in order
+typedef struct {
+	char *payload; // Request bytes, kept so they can be resent if the worker dies
+	uint32_t len;
+	int owned; // payload was copied by pool_submit and must be freed
+	int worker; // Worker the request was dispatched to
+	int done; // Response has arrived
+	char *resp; // Copy of the response payload
+	uint32_t resp_len;
+} Request;
+
+// Pre-forked workers plus a reorder window indexed by request ID
+typedef struct {
+	int kind; // Transport for every worker
+	int nworkers;
+	int by_key; // Dispatch by hash of the first word instead of least loaded
+	int discard; // Only record that responses arrived, don't keep their bytes (benchmark)
+	Worker workers[MAX_WORKERS];
+	Waiter *waiter; // shm only: every worker wakes the parent through this one word
+	Request *reqs; // Circular, slot for ID is id & (cap - 1)
+	uint32_t cap; // Size of reqs, a power of two
+	uint32_t next_id; // ID the next submitted request gets
+	uint32_t next_emit; // Oldest request not yet handed back
+	int rr; // Where the least-loaded scan starts, so ties rotate between workers
+	long respawns; // Workers replaced after dying
+} Pool;
+
+Request *pool_slot(Pool *p, uint32_t id) {
+	return &p->reqs[id & (p->cap - 1)];
+}
+
+// Number of submitted requests not yet handed back
+uint32_t pool_pending(const Pool *p) {
+	return p->next_id - p->next_emit;
+}
 
-		char *line = NULL;
-		size_t cap = 0;
-		ssize_t len;
-		while((len = getline(&line, &cap, from_parent)) != -1) { // Child repeatedly reads lines from parent
-			fprintf(to_parent, "Child (pid %d) received: %s", getpid(), line); // Sends reply back through pipe2
-			fflush(to_parent); // Pushes data quickly
+// Runs in every new worker: drop the parent's ends of the other workers' channels
+// Otherwise a worker would hold another worker's pipe open and that one would never see EOF
+void pool_close_inherited(void *arg) {
+	Pool *p = arg;
+	for(int i = 0; i < p->nworkers; i++) {
+		Channel *ch = &p->workers[i].ch;
+		if(!ch->is_parent) {
+			continue; // Not started yet, or this is the slot being respawned
 		}
-		free(line); // Free allocated memory
-		fclose(from_parent); // Closes pipes
-		fclose(to_parent);
-		return 0;
+		if(ch->kind == CHAN_PIPE) {
+			close(ch->out_fd);
+			close(ch->in_fd);
+		} else {
+			munmap(ch->shm, sizeof(ShmRegion));
+		}
+	}
+}
+
+// Replaces dead worker i and resends every request it still owed us, to the same slot so key affinity holds
+int pool_respawn(Pool *p, int i) {
+	Worker *w = &p->workers[i];
+	pid_t old = w->ch.pid;
+
+	chan_destroy(&w->ch);
+	w->out.start = w->out.end = 0;
+	w->in.start = w->in.end = 0;
+	w->in_flight = 0;
+	if(spawn_child(&w->ch, p->kind, p->waiter, pool_close_inherited, p) == -1) {
+		return -1;
+	}
+	p->respawns++;
+
+	for(uint32_t id = p->next_emit; id != p->next_id; id++) {
+		Request *r = pool_slot(p, id);
+		if(!r->done && r->worker == i) {
+			if(buf_append_frame(&w->out, id, r->payload, r->len) == -1) {
+				perror("malloc");
+				return -1;
+			}
+			w->in_flight++;
+		}
+	}
+	fprintf(stderr, "Worker %d (pid %d) died, respawned as pid %d with %ld requests resent\n",
+		i, old, w->ch.pid, w->in_flight);
+	return 0;
+}
+
+// Collects any worker that exited and respawns it
+int pool_reap(Pool *p) {
+	pid_t pid;
+	while((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+		for(int i = 0; i < p->nworkers; i++) {
+			if(p->workers[i].ch.pid == pid) {
+				p->workers[i].ch.reaped = 1;
+				if(pool_respawn(p, i) == -1) {
+					return -1;
+				}
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
+// Starts n workers using the given transport
+int pool_start(Pool *p, int kind, int n, int by_key) {
+	memset(p, 0, sizeof(*p));
+	p->kind = kind;
+	p->nworkers = n;
+	p->by_key = by_key;
+	p->cap = 1024;
+	p->reqs = calloc(p->cap, sizeof(Request));
+	if(p->reqs == NULL) {
+		perror("calloc");
+		return -1;
+	}
+	if(kind == CHAN_SHM) {
+		p->waiter = mmap(NULL, sizeof(Waiter), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if(p->waiter == MAP_FAILED) {
+			perror("mmap");
+			p->waiter = NULL;
+			free(p->reqs);
+			return -1;
+		}
+	}
+	for(int i = 0; i < n; i++) {
+		if(spawn_child(&p->workers[i].ch, kind, p->waiter, pool_close_inherited, p) == -1) {
+			p->nworkers = i;
+			return -1; // Caller still runs pool_stop to collect the ones that started
+		}
+	}
+	return 0;
+}
+
+// Closes every channel, collects the workers, and frees what is left
+void pool_stop(Pool *p) {
+	for(int i = 0; i < p->nworkers; i++) {
+		Worker *w = &p->workers[i];
+		if(!w->ch.is_parent) {
+			continue;
+		}
+		if(w->in_flight > 0) {
+			kill(w->ch.pid, SIGKILL); // Bailing out early, don't wait for it to drain replies nobody reads
+		}
+		chan_destroy(&w->ch);
+		free(w->out.data);
+		free(w->in.data);
+	}
+	for(uint32_t id = p->next_emit; id != p->next_id; id++) {
+		Request *r = pool_slot(p, id);
+		if(r->owned) {
+			free(r->payload);
+		}
+		free(r->resp);
+	}
+	free(p->reqs);
+	if(p->waiter != NULL) {
+		munmap(p->waiter, sizeof(Waiter));
+	}
+}
+
+// FNV-1a of the first whitespace-delimited word, used for key affinity
+uint32_t key_hash(const char *s, uint32_t len) {
+	uint32_t h = 2166136261u;
+	for(uint32_t i = 0; i < len && s[i] != ' ' && s[i] != '\t' && s[i] != '\n'; i++) {
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+	}
+	return h;
+}
+
+// Chooses a worker: the same one for the same key, or the one with the fewest requests in flight
+int pool_pick(Pool *p, const char *payload, uint32_t len) {
+	if(p->by_key) {
+		return (int)(key_hash(payload, len) % (uint32_t)p->nworkers);
+	}
+	int best = -1;
+	for(int k = 0; k < p->nworkers; k++) {
+		int i = (p->rr + k) % p->nworkers;
+		if(best == -1 || p->workers[i].in_flight < p->workers[best].in_flight) {
+			best = i;
+		}
+	}
+	p->rr = (best + 1) % p->nworkers;
+	return best;
+}
+
+// Queues one request. copy makes the pool keep its own copy of payload, otherwise payload must outlive the request
+int pool_submit(Pool *p, const char *payload, uint32_t len, int copy) {
+	if(pool_pending(p) == p->cap) { // Reorder window is full, double it
+		uint32_t newcap = p->cap * 2;
+		Request *reqs = calloc(newcap, sizeof(Request));
+		if(reqs == NULL) {
+			perror("calloc");
+			return -1;
+		}
+		for(uint32_t id = p->next_emit; id != p->next_id; id++) {
+			reqs[id & (newcap - 1)] = *pool_slot(p, id);
+		}
+		free(p->reqs);
+		p->reqs = reqs;
+		p->cap = newcap;
+	}
+
+	uint32_t id = p->next_id;
+	Request *r = pool_slot(p, id);
+	memset(r, 0, sizeof(*r));
+	r->len = len;
+	if(copy) {
+		r->payload = malloc(len ? len : 1);
+		if(r->payload == NULL) {
+			perror("malloc");
+			return -1;
+		}
+		memcpy(r->payload, payload, len);
+		r->owned = 1;
 	} else {
-		// Parent process
-		// TODO : Close unused pipe ends
-		// close (pipe1 [0]) ; // Close read end of pipe1
-		// close (pipe2 [1]) ; // Close write end of pipe2
+		r->payload = (char *)payload;
+	}
+	r->worker = pool_pick(p, payload, len);
 
-		close(pipe1[0]); // Parent doesn't read from pipe1
-		close(pipe2[1]); // Parent doesn't write to pipe2
+	Worker *w = &p->workers[r->worker];
+	if(buf_append_frame(&w->out, id, r->payload, len) == -1) {
+		perror("malloc");
+		if(r->owned) {
+			free(r->payload);
+		}
+		return -1;
+	}
+	w->in_flight++;
+	p->next_id++;
+	return 0;
+}
+
+// Moves bytes between the parent and every worker and records arrived responses
+// Returns 1 if anything moved, 0 if not, -1 on a fatal error
+int pool_pump(Pool *p) {
+	int progress = 0;
+	for(int i = 0; i < p->nworkers; i++) {
+		Worker *w = &p->workers[i];
+		int dead = 0;
+
+		if(buf_used(&w->out) > 0) {
+			size_t before = buf_used(&w->out);
+			if(chan_flush(&w->ch, &w->out) == -1) {
+				if(errno != EPIPE) {
+					perror("write to worker");
+					return -1;
+				}
+				dead = 1;
+			}
+			if(buf_used(&w->out) < before) {
+				progress = 1;
+			}
+		}
+
+		ssize_t n = chan_fill(&w->ch, &w->in);
+		if(n == 0) {
+			dead = 1;
+		} else if(n > 0) {
+			progress = 1;
+		} else if(errno != EAGAIN) {
+			perror("read from worker");
+			return -1;
+		}
+
+		FrameHeader hdr;
+		char *payload;
+		while(buf_next_frame(&w->in, &hdr, &payload) == 1) {
+			Request *r = pool_slot(p, hdr.id);
+			if(hdr.id - p->next_emit >= pool_pending(p) || r->done || r->worker != i) {
+				fprintf(stderr, "Unexpected response ID %u from worker %d\n", hdr.id, i);
+				return -1;
+			}
+			if(!p->discard) {
+				r->resp = malloc(hdr.len ? hdr.len : 1);
+				if(r->resp == NULL) {
+					perror("malloc");
+					return -1;
+				}
+				memcpy(r->resp, payload, hdr.len);
+				r->resp_len = hdr.len;
+			}
+			r->done = 1;
+			w->in_flight--;
+		}
 
-		// Turns FDs into FILE* for easier I/O
-		FILE *to_child = fdopen(pipe1[1], "w");
-		FILE *from_child = fdopen(pipe2[0], "r");
-		if(!to_child || !from_child) {
-			perror("fdopen parent"); // Print message on error
+		if(dead) {
+			if(!w->ch.reaped) {
+				waitpid(w->ch.pid, NULL, 0); // Its end closed, so it is exiting
+				w->ch.reaped = 1;
+			}
+			if(pool_respawn(p, i) == -1) {
+				return -1;
+			}
+			progress = 1;
+		}
+	}
+	return progress;
+}
+
+// True when some worker's rings have something for us or room for what we have queued
+int pool_shm_ready(Pool *p) {
+	for(int i = 0; i < p->nworkers; i++) {
+		if(shm_ready(&p->workers[i].ch, 1, buf_used(&p->workers[i].out) > 0)) {
 			return 1;
 		}
+	}
+	return 0;
+}
+
+// Blocks until some worker can make progress or extra_fd (if not -1) is readable
+// Returns a mask of CHAN_READY and EXTRA_READY, or -1 on a fatal error
+int pool_wait(Pool *p, int extra_fd) {
+	if(p->kind == CHAN_PIPE) {
+		struct pollfd pfd[2 * MAX_WORKERS + 1];
+		int nfds = 0;
+		for(int i = 0; i < p->nworkers; i++) {
+			Worker *w = &p->workers[i];
+			pfd[nfds].fd = w->ch.in_fd;
+			pfd[nfds].events = POLLIN;
+			pfd[nfds++].revents = 0;
+			pfd[nfds].fd = buf_used(&w->out) > 0 ? w->ch.out_fd : -1;
+			pfd[nfds].events = POLLOUT;
+			pfd[nfds++].revents = 0;
+		}
+		pfd[nfds].fd = extra_fd;
+		pfd[nfds].events = POLLIN;
+		pfd[nfds].revents = 0;
+		if(poll(pfd, (nfds_t)nfds + 1, -1) == -1) {
+			return 0; // EINTR, caller just retries
+		}
+		return CHAN_READY | (pfd[nfds].revents ? EXTRA_READY : 0);
+	}
+
+	// Same eventcount dance as chan_wait, except every worker notifies the one pool waiter
+	for(int i = 0; i < shm_spin; i++) {
+		if(pool_shm_ready(p)) {
+			return CHAN_READY;
+		}
+	}
+	if(extra_fd != -1) {
+		struct pollfd pfd = { extra_fd, POLLIN, 0 };
+		if(poll(&pfd, 1, 0) > 0) {
+			return EXTRA_READY;
+		}
+	}
+	uint32_t seq = atomic_load(&p->waiter->seq);
+	atomic_store_explicit(&p->waiter->waiting, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	if(pool_shm_ready(p)) {
+		atomic_store(&p->waiter->waiting, 0);
+		return CHAN_READY;
+	}
+	futex_wait(&p->waiter->seq, seq, extra_fd != -1 ? 10 : 100);
+	atomic_store(&p->waiter->waiting, 0);
+	if(!pool_shm_ready(p) && pool_reap(p) == -1) { // Nothing to do, so check whether a worker died
+		return -1;
+	}
+	return CHAN_READY;
+}
+
+// Returns the oldest request if its response has arrived, so responses come back in submission order
+Request *pool_next(Pool *p, uint32_t *id) {
+	if(pool_pending(p) == 0) {
+		return NULL;
+	}
+	Request *r = pool_slot(p, p->next_emit);
+	if(!r->done) {
+		return NULL;
+	}
+	*id = p->next_emit;
+	return r;
+}
+
+// Frees the request returned by pool_next and moves on to the next one
+void pool_release(Pool *p, Request *r) {
+	if(r->owned) {
+		free(r->payload);
+	}
+	free(r->resp);
+	memset(r, 0, sizeof(*r));
+	p->next_emit++;
+}
+
+// Interactive parent: every stdin line becomes one request, responses are printed in input order
+// Input is read with read() rather than getline so the wait sees exactly what is still unprocessed
+int run_interactive(Pool *p) {
+	ByteBuf input = {0};
+	int stdin_open = 1;
+	int rc = 0;
+
+	fprintf(stderr, "Parent: type message to send to child. Type 'exit' to quit.\n"); // Prompts user on stderr for input because stdout is reserved for child's replies
+	fprintf(stderr, ">");
+	fflush(stderr);
+
+	while(stdin_open || pool_pending(p) > 0) {
+		int ready = pool_wait(p, stdin_open ? STDIN_FILENO : -1);
+		if(ready == -1) {
+			rc = 1;
+			break;
+		}
+
+		// Turn complete stdin lines into requests
+		if(ready & EXTRA_READY) {
+			ssize_t n = buf_fill(&input, STDIN_FILENO);
+			if(n <= 0) {
+				stdin_open = 0;
+				if(buf_used(&input) > 0) { // Send a final line without a newline as well
+					buf_append(&input, "\n", 1);
+				}
+			}
+			char *nl;
+			while(buf_used(&input) > 0 &&
+			      (nl = memchr(input.data + input.start, '\n', buf_used(&input))) != NULL) {
+				char *line = input.data + input.start;
+				size_t len = (size_t)(nl - line) + 1;
+				input.start += len;
+
+				// Exit condition
+				if(strncmp(line, "exit", 4) == 0) {
+					stdin_open = 0;
+					break;
+				}
+				if(pool_submit(p, line, (uint32_t)len, 1) == -1) {
+					rc = 1;
+					goto done;
+				}
+			}
+		}
 
-		// TODO : Send messages , read responses
-		// TODO: wait () for child
+		if(pool_pump(p) == -1) {
+			rc = 1;
+			break;
+		}
 
-		char *line = NULL;
-		size_t cap = 0;
-		ssize_t len;
-		fprintf(stderr, "Parent: type message to send to child. Type 'exit' to quit.\n"); // Prompts user on stderr for input because stdout is reserved for child's replies
-		while(1) {
+		// Print every response that is next in line
+		Request *r;
+		uint32_t id;
+		int got = 0;
+		while((r = pool_next(p, &id)) != NULL) {
+			fwrite(r->resp, 1, r->resp_len, stdout); // Prints child's response to stdout
+			pool_release(p, r);
+			got = 1;
+		}
+		fflush(stdout); // Pushes data quickly
+		if(got && pool_pending(p) == 0 && stdin_open) {
 			fprintf(stderr, ">");
 			fflush(stderr);
-			if((len = getline(&line, &cap, stdin)) == -1){ // Reads line from user
-				break;
+		}
+	}
+
+done:
+	free(input.data); // Free allocated memory
+	return rc;
+}
+
+int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+// Results of one benchmark run
+typedef struct {
+	double elapsed; // Seconds from first send to last response
+	double msgs_per_sec;
+	double mb_per_sec; // Request payload throughput
+	double avg_us, p50_us, p99_us, max_us; // Round-trip latency, measured when the response is handed back in order
+} BenchResult;
+
+// Benchmark parent: keep up to window requests of msg_size bytes in flight and time each round trip
+// With key dispatch every request starts with one of 1024 keys so the load spreads over the workers
+int run_benchmark(Pool *p, long count, size_t msg_size, long window, BenchResult *res) {
+	char *payload = malloc(msg_size ? msg_size : 1);
+	uint64_t *sent_at = malloc((size_t)count * sizeof(uint64_t)); // Send time indexed by request ID
+	uint64_t *latency = malloc((size_t)count * sizeof(uint64_t));
+	long sent = 0, received = 0;
+	int rc = 0;
+
+	if(payload == NULL || sent_at == NULL || latency == NULL) {
+		perror("malloc");
+		rc = 1;
+		goto done;
+	}
+	memset(payload, 'x', msg_size);
+	p->discard = 1; // Only timing matters here
+
+	uint64_t start = now_ns();
+	while(received < count) {
+		// Top the window back up
+		while(sent < count && sent - received < window) {
+			sent_at[sent] = now_ns();
+			int ok;
+			if(p->by_key) {
+				char key[16];
+				size_t k = (size_t)snprintf(key, sizeof(key), "k%ld ", sent % 1024);
+				memcpy(payload, key, k < msg_size ? k : msg_size);
+				ok = pool_submit(p, payload, (uint32_t)msg_size, 1);
+			} else {
+				ok = pool_submit(p, payload, (uint32_t)msg_size, 0); // Every request shares one payload
 			}
-			// Send input to child
-			if(fwrite(line, 1, (size_t)len, to_child) != (size_t)len) {
-				perror("write to child");
-				break;
+			if(ok == -1) {
+				rc = 1;
+				goto done;
 			}
-			fflush(to_child); // Pushes data quickly
+			sent++;
+		}
 
-			// Exit condition
-			if(strncmp(line, "exit", 4) == 0) {
-				break;
+		int progress = pool_pump(p);
+		if(progress == -1) {
+			rc = 1;
+			goto done;
+		}
+
+		uint64_t now = now_ns();
+		Request *r;
+		uint32_t id;
+		while((r = pool_next(p, &id)) != NULL) {
+			latency[received++] = now - sent_at[id];
+			pool_release(p, r);
+			progress = 1;
+		}
+
+		if(!progress && pool_wait(p, -1) == -1) { // Nothing moved either way, so sleep until something can
+			rc = 1;
+			goto done;
+		}
+	}
+	uint64_t elapsed_ns = now_ns() - start;
+
+	// Summarize throughput and the latency distribution
+	qsort(latency, (size_t)count, sizeof(uint64_t), compare_u64);
+	double sum = 0.0;
+	for(long i = 0; i < count; i++) {
+		sum += (double)latency[i];
+	}
+	res->elapsed = (double)elapsed_ns / 1e9;
+	res->msgs_per_sec = (double)count / res->elapsed;
+	res->mb_per_sec = (double)count * (double)msg_size / 1024.0 / 1024.0 / res->elapsed;
+	res->avg_us = sum / (double)count / 1e3;
+	res->p50_us = (double)latency[count / 2] / 1e3;
+	res->p99_us = (double)latency[(count * 99) / 100] / 1e3;
+	res->max_us = (double)latency[count - 1] / 1e3;
+
+done:
+	free(payload); // Free allocated memory
+	free(sent_at);
+	free(latency);
+	return rc;
+}
+
+// Runs the benchmark for both transports over a range of message sizes and prints one row per run
+int run_sweep(long count, long window, int workers, int by_key) {
+	static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576 };
+	const char *names[] = { "pipe", "shm" };
+
+	printf("%-9s %9s %12s %10s %10s %10s %10s\n", "transport", "size", "msgs/s", "MB/s", "avg us", "p50 us", "p99 us");
+	for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		// Cap each run at about 256 MB of payload so large sizes finish in reasonable time
+		long n = count;
+		if((double)n * (double)sizes[s] > 256.0 * 1024 * 1024) {
+			n = (long)((256u * 1024 * 1024) / sizes[s]);
+		}
+		for(int kind = CHAN_PIPE; kind <= CHAN_SHM; kind++) {
+			Pool pool;
+			BenchResult res;
+			int rc = pool_start(&pool, kind, workers, by_key);
+			if(rc == 0) {
+				rc = run_benchmark(&pool, n, sizes[s], window, &res);
+			}
+			pool_stop(&pool);
+			if(rc != 0) {
+				return 1;
 			}
+			printf("%-9s %9zu %12.0f %10.2f %10.2f %10.2f %10.2f\n",
+				names[kind], sizes[s], res.msgs_per_sec, res.mb_per_sec, res.avg_us, res.p50_us, res.p99_us);
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
 
-			// Read child's response
-			char respbuf[4096];
-			if(fgets(respbuf, sizeof(respbuf), from_child) != NULL) { // Gets child's response
-				printf("%s", respbuf); // Prints child's response to stdout
-				fflush(stdout); // Pushes data quickly
-			} else {
+int main(int argc, char *argv[]) {
+	// Extra variables
+	int getopt_ret;
+	char opt;
+	int bench = 0;
+	int sweep = 0;
+	int kind = CHAN_PIPE;
+	int workers = 1; // Pre-forked worker processes
+	int by_key = 0; // Dispatch by key hash instead of least loaded
+	long count = 100000; // Benchmark messages
+	long msg_size = 64; // Benchmark payload bytes
+	long window = 64; // Max requests in flight during the benchmark
+
+	while((getopt_ret = getopt(argc, argv, "bSn:s:w:t:P:kh")) != -1) {
+		opt = (char)getopt_ret;
+		switch(opt) {
+			case 'b': // Benchmark mode
+				bench = 1;
 				break;
-			}
+			case 'S': // Compare transports across message sizes
+				sweep = 1;
+				break;
+			case 'n': // Message count
+				count = atol(optarg);
+				if(count <= 0 || count > UINT32_MAX) {
+					fprintf(stderr, "Invalid message count: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 's': // Message size
+				msg_size = atol(optarg);
+				if(msg_size < 0 || msg_size > UINT32_MAX - 64) {
+					fprintf(stderr, "Invalid message size: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'w': // Window
+				window = atol(optarg);
+				if(window <= 0) {
+					fprintf(stderr, "Invalid window: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 't': // Transport
+				if(strcmp(optarg, "pipe") == 0) {
+					kind = CHAN_PIPE;
+				} else if(strcmp(optarg, "shm") == 0) {
+					kind = CHAN_SHM;
+				} else {
+					fprintf(stderr, "Invalid transport: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'P': // Worker count
+				workers = atoi(optarg);
+				if(workers <= 0 || workers > MAX_WORKERS) {
+					fprintf(stderr, "Invalid worker count: %s (1-%d)\n", optarg, MAX_WORKERS);
+					return 1;
+				}
+				break;
+			case 'k': // Key affinity
+				by_key = 1;
+				break;
+			case 'h': // Help
+			default:
+				fprintf(stderr, "Usage: %s [-t pipe|shm] [-P workers] [-k] [-b] [-S] [-n count] [-s size] [-w window]\n", argv[0]);
+				return 1;
 		}
+	}
 
-		free(line); // Free allocated memory
-		fclose(to_child); // Closes pipes
-		fclose(from_child);
-		wait(NULL); // Wait for child to finish
+	signal(SIGPIPE, SIG_IGN); // A dead child shows up as EPIPE instead of killing the parent
+	if(sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+		shm_spin = 0;
+	}
+
+	if(sweep) {
+		return run_sweep(count, window, workers, by_key);
+	}
+
+	Pool pool;
+	int rc = pool_start(&pool, kind, workers, by_key);
+	if(rc == 0 && bench) {
+		BenchResult res;
+		rc = run_benchmark(&pool, count, (size_t)msg_size, window, &res);
+		if(rc == 0) {
+			printf("Messages: %ld size: %ld window: %ld transport: %s workers: %d\n",
+				count, msg_size, window, kind == CHAN_SHM ? "shm" : "pipe", workers);
+			printf("Time (sec): %.6f\n", res.elapsed);
+			printf("Messages/s: %.2f\n", res.msgs_per_sec);
+			printf("Throughput (MB/s): %.2f\n", res.mb_per_sec);
+			printf("Latency (us): avg %.2f p50 %.2f p99 %.2f max %.2f\n", res.avg_us, res.p50_us, res.p99_us, res.max_us);
+			printf("Respawns: %ld\n", pool.respawns);
+		}
+	} else if(rc == 0) {
+		rc = run_interactive(&pool);
 	}
 
-	return 0; // Signal success
+	pool_stop(&pool); // Workers see EOF, exit, and are collected here
+	return rc != 0; // Signal success
 }
@@ -1,13 +1,146 @@
+#define _GNU_SOURCE // F_SETPIPE_SZ
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <getopt.h>
 #include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "uring.h"
+#include "keyagg.h"
+
+#define URING_BUF_SIZE (1 << 18) // Bytes per read in the io_uring path
+
+// Counts the lines in one block exactly like the getline loop does, echoing them when verbose
+// partial tracks a line that continues into the next block, agg (if not NULL) gets every line's key
+// Returns 1 once max_lines is reached
+int count_block(const char *buf, size_t len, int max_lines, int verbose, KeyAgg *agg, long long *line_count, long long *char_count, int *partial) {
+	const char *p = buf, *end = buf + len;
+	int stop = 0;
+	while(p < end) {
+		const char *nl = memchr(p, '\n', (size_t)(end - p));
+		if(nl == NULL) { // Line runs into the next block
+			*char_count += end - p;
+			*partial = 1;
+			if(agg != NULL) {
+				agg_partial(agg, p, (size_t)(end - p));
+			}
+			p = end;
+			break;
+		}
+		*char_count += nl + 1 - p;
+		(*line_count)++;
+		if(agg != NULL) {
+			agg_line(agg, p, (size_t)(nl + 1 - p));
+		}
+		*partial = 0;
+		p = nl + 1;
+		if(max_lines != -1 && *line_count >= max_lines) {
+			stop = 1;
+			break;
+		}
+	}
+	if(verbose) {
+		ssize_t w = fwrite(buf, 1, (size_t)(p - buf), stdout); // Echo the block, up to where we stopped
+		(void)w;
+		fflush(stdout);
+	}
+	return stop;
+}
+
+// io_uring read loop: the next block is already being read into the other buffer while this one is counted
+// Returns 0 on success, 1 on an I/O error, -1 (errno set) if io_uring is unavailable and nothing was read
+int consume_uring(int fd, int max_lines, int verbose, KeyAgg *agg, long long *line_count, long long *char_count) {
+	Uring ring;
+	struct iovec iov[2];
+	int partial = 0;
+	int cur = 0;
+
+	if(uring_init(&ring, 4) == -1) {
+		return -1;
+	}
+	char *mem = malloc(2 * URING_BUF_SIZE);
+	if(mem == NULL) {
+		perror("malloc");
+		uring_exit(&ring);
+		return 1;
+	}
+	for(int i = 0; i < 2; i++) {
+		iov[i].iov_base = mem + i * URING_BUF_SIZE;
+		iov[i].iov_len = URING_BUF_SIZE;
+	}
+	int fixed = uring_register_buffers(&ring, iov, 2) == 0;
+
+	if(uring_queue_rw(&ring, 0, fd, iov[cur].iov_base, URING_BUF_SIZE, (uint64_t)-1, fixed ? cur : -1, (uint64_t)cur) == -1) {
+		fprintf(stderr, "io_uring: submission queue full\n");
+		uring_exit(&ring);
+		free(mem);
+		return 1;
+	}
+	while(1) {
+		if(uring_submit_and_wait(&ring, 1) == -1) {
+			perror("io_uring_enter");
+			uring_exit(&ring);
+			return 1; // The read may still own the buffer, so mem is left for process exit to reclaim
+		}
+		struct io_uring_cqe *cqe = uring_peek(&ring);
+		if(cqe == NULL) {
+			continue;
+		}
+		int res = cqe->res;
+		uring_seen(&ring);
+		if(res < 0) {
+			errno = -res;
+			perror("io_uring read");
+			uring_exit(&ring);
+			free(mem);
+			return 1;
+		}
+		if(res == 0) {
+			break; // EOF
+		}
+
+		// Start reading the next block into the other buffer, then count this one
+		int filled = cur;
+		cur ^= 1;
+		if(uring_queue_rw(&ring, 0, fd, iov[cur].iov_base, URING_BUF_SIZE, (uint64_t)-1, fixed ? cur : -1, (uint64_t)cur) == -1) {
+			fprintf(stderr, "io_uring: submission queue full\n"); // Nothing is in flight, so waiting would hang
+			uring_exit(&ring);
+			free(mem);
+			return 1;
+		}
+		if(uring_submit_and_wait(&ring, 0) == -1) {
+			perror("io_uring_enter");
+			uring_exit(&ring);
+			return 1; // mem is left for process exit to reclaim, as above
+		}
+		if(count_block(iov[filled].iov_base, (size_t)res, max_lines, verbose, agg, line_count, char_count, &partial)) {
+			uring_exit(&ring);
+			return 0; // Hit max lines with a read still pending, so mem is left for process exit to reclaim
+		}
+	}
+	if(partial) {
+		(*line_count)++; // getline also returns a last line that has no newline
+		if(agg != NULL) {
+			agg_finish(agg);
+		}
+	}
+	uring_exit(&ring);
+	free(mem);
+	return 0;
+}
 
 int main (int argc, char *argv[]){
 	int max_lines = -1;
 	int verbose = 0;
+	int pipe_size = 0; // 0 keeps the kernel's default pipe capacity
+	int use_uring = 0;
+	int done = 0; // Set when the io_uring path already read everything
+	int key_field = -1; // -1 just counts lines, otherwise the field whose values are counted (0 = whole line)
+	char delim = ' ';
+	int top_k = 10;
+	KeyAgg agg;
 
 	//Extra variables
 	int getopt_ret;
@@ -20,7 +153,7 @@ int main (int argc, char *argv[]){
 
 	// TODO : Parse arguments ( - n max_lines , -v verbose )
 
-	while((getopt_ret = getopt(argc, argv, "n:vh")) != -1) {
+	while((getopt_ret = getopt(argc, argv, "n:p:uk:d:t:vh")) != -1) {
 		opt = (char)getopt_ret;
 		switch(opt){
 			case 'n': // Max lines
@@ -29,22 +162,75 @@ int main (int argc, char *argv[]){
 					max_lines = -1;
 				}
 				break;
+			case 'p': // Pipe capacity
+				pipe_size = atoi(optarg);
+				if(pipe_size <= 0){
+					fprintf(stderr, "Invalid pipe size: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'u': // io_uring backend
+				use_uring = 1;
+				break;
+			case 'k': // Key field to aggregate
+				key_field = atoi(optarg);
+				if(key_field < 0){
+					fprintf(stderr, "Invalid field index: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'd': // Field delimiter
+				delim = strcmp(optarg, "\\t") == 0 ? '\t' : optarg[0];
+				break;
+			case 't': // Keys to report
+				top_k = atoi(optarg);
+				if(top_k <= 0){
+					fprintf(stderr, "Invalid top count: %s\n", optarg);
+					return 1;
+				}
+				break;
 			case 'v': // Verbose
 				verbose = 1;
 				break;
 			case 'h': // Help
 			default:
-				fprintf(stderr, "Usage: %s [-n max_lines] [-v]\n", argv[0]);
+				fprintf(stderr, "Usage: %s [-n max_lines] [-p pipe_size] [-u] [-k field [-d delim] [-t top]] [-v]\n", argv[0]);
 				return 1;
 		}
 	}
 
+	// Grow the pipe we read from, so fewer context switches are needed per MB
+	if(pipe_size > 0 && fcntl(STDIN_FILENO, F_SETPIPE_SZ, pipe_size) == -1) {
+		perror("F_SETPIPE_SZ"); // Not a pipe or over the limit, keep going with the default
+	}
+
+	// Aggregation mode counts occurrences of one field per line, fields are 1-based and -k 0 uses the whole line
+	if(key_field >= 0) {
+		agg_init(&agg, key_field, delim);
+	}
+
+	// Overlapped io_uring path, falls back to the getline loop below if the kernel doesn't offer it
+	if(use_uring) {
+		int rc = consume_uring(STDIN_FILENO, max_lines, verbose, key_field >= 0 ? &agg : NULL, &line_count, &char_count);
+		if(rc == 1) {
+			return 1;
+		}
+		if(rc == -1) {
+			fprintf(stderr, "io_uring unavailable (%s), using blocking I/O\n", strerror(errno));
+		} else {
+			done = 1;
+		}
+	}
+
 	// TODO : Read from stdin line by line
 	// Count lines and characters
 
-	while((linelen = getline(&line, &linecap, stdin)) != -1) { // Repeatedly reads from stdin into line
+	while(!done && (linelen = getline(&line, &linecap, stdin)) != -1) { // Repeatedly reads from stdin into line
 		line_count++; // Count line
 		char_count += linelen; // Add line's character count to total
+		if(key_field >= 0) {
+			agg_line(&agg, line, (size_t)linelen); // Count this line's key
+		}
 
 		// If verbose, echo lines to stdout
 
@@ -66,6 +252,14 @@ int main (int argc, char *argv[]){
 	fprintf(stderr, "Lines: %lld\n", line_count);
         fprintf(stderr, "Characters (bytes): %lld\n", char_count);
 
+	// Top keys go to stdout so they can be piped on, the summary joins the other stats
+	if(key_field >= 0) {
+		agg_top(&agg, (size_t)top_k, stdout);
+		fprintf(stderr, "Distinct keys: %zu\n", agg.used);
+		fprintf(stderr, "Lines without field %d: %lld\n", key_field, agg.missing);
+		agg_free(&agg);
+	}
+
 	free(line); // Free allocated memory
 	return 0; // Signal success
 }
@@ -1,11 +1,15 @@
+#define _GNU_SOURCE // F_SETPIPE_SZ
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <getopt.h>
 #include <time.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include "keyagg.h"
+#include "latency.h"
 
 // Global flags for signal handlers
 volatile sig_atomic_t shutdown_flag = 0; // Set to 1 when SIGINT receieved
@@ -23,10 +27,57 @@ void handle_sigusr1(int sig) {
     stats_flag = 1; // Request stats
 }
 
+// Monotonic clock in nanoseconds, the same clock producer -r stamps records with
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Latency mode: the line starts with its send time in ns, record how long ago that was
+void record_latency(LatHist *lat, const char *line, long long *bad_stamps) {
+    char *end;
+    errno = 0;
+    unsigned long long stamp = strtoull(line, &end, 10);
+    if (end == line || errno != 0) {
+        (*bad_stamps)++;
+        return;
+    }
+    uint64_t now = now_ns();
+    lat_record(lat, now > stamp ? now - stamp : 0); // Scheduled stamps can be a hair in the future
+}
+
+// SIGUSR1 report: progress so far, plus the current top keys in aggregation mode and latencies in latency mode
+void print_progress(clock_t start_clock, long long line_count, long long char_count, const KeyAgg *agg, int top_k, const LatHist *lat) {
+    clock_t now = clock();
+    double elapsed = ((double)(now - start_clock)) / CLOCKS_PER_SEC;
+    if (elapsed <= 0.0) elapsed = 1e-9;
+    double lines_per_sec = (double)line_count / elapsed;
+    double bytes_per_sec = (double)char_count / elapsed;
+    double mbps = (double)char_count / 1024.0 / 1024.0 / elapsed;
+    fprintf(stderr, "[consumer SIGUSR1] lines: %lld bytes: %lld time(s): %.6f lines/s: %.6f bytes/s: %.6f MB/s: %.6f\n",
+            line_count, char_count, elapsed, lines_per_sec, bytes_per_sec, mbps);
+    if (agg != NULL) {
+        fprintf(stderr, "[consumer SIGUSR1] distinct keys: %zu, top %d:\n", agg->used, top_k);
+        agg_top(agg, (size_t)top_k, stderr); // stderr, so a snapshot never mixes into the final list on stdout
+    }
+    if (lat != NULL) {
+        lat_print(lat, "[consumer SIGUSR1] ", stderr);
+    }
+}
+
 // consumer.c stuff
 int main (int argc, char *argv[]){
     int max_lines = -1;
     int verbose = 0;
+    int pipe_size = 0; // 0 keeps the kernel's default pipe capacity
+    int key_field = -1; // -1 just counts lines, otherwise the field whose values are counted (0 = whole line)
+    char delim = ' ';
+    int top_k = 10;
+    KeyAgg agg;
+    int latency_mode = 0; // Lines carry a send timestamp (producer -r), histogram their latency
+    LatHist *lat = NULL;
+    long long bad_stamps = 0;
 
     int getopt_ret;
     char opt;
@@ -35,6 +86,8 @@ int main (int argc, char *argv[]){
     ssize_t linelen;
     long long line_count = 0;
     long long char_count = 0;
+    char *piece = NULL; // Start of a line whose read was interrupted by SIGUSR1
+    size_t piece_len = 0, piece_cap = 0;
 
     // Setup signal handlers (SIGINT and SIGUSR1)
     struct sigaction sa_int, sa_usr1;
@@ -58,7 +111,7 @@ int main (int argc, char *argv[]){
     clock_t start_clock = clock();
 
     // consumer.c stuff
-    while((getopt_ret = getopt(argc, argv, "n:vh")) != -1) {
+    while((getopt_ret = getopt(argc, argv, "n:p:k:d:t:Lvh")) != -1) {
         opt = (char)getopt_ret;
         switch(opt){
             case 'n':
@@ -67,17 +120,112 @@ int main (int argc, char *argv[]){
                     max_lines = -1;
                 }
                 break;
+            case 'p':
+                pipe_size = atoi(optarg);
+                if(pipe_size <= 0){
+                    fprintf(stderr, "Invalid pipe size: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'k':
+                key_field = atoi(optarg);
+                if(key_field < 0){
+                    fprintf(stderr, "Invalid field index: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                delim = strcmp(optarg, "\\t") == 0 ? '\t' : optarg[0];
+                break;
+            case 't':
+                top_k = atoi(optarg);
+                if(top_k <= 0){
+                    fprintf(stderr, "Invalid top count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'L':
+                latency_mode = 1;
+                break;
             case 'v':
                 verbose = 1;
                 break;
             case 'h':
             default:
-                fprintf(stderr, "Usage: %s [-n max_lines] [-v]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-n max_lines] [-p pipe_size] [-k field [-d delim] [-t top]] [-L] [-v]\n", argv[0]);
                 return 1;
         }
     }
 
-    while((linelen = getline(&line, &linecap, stdin)) != -1) {
+    // Grow the pipe we read from, so fewer context switches are needed per MB
+    if(pipe_size > 0 && fcntl(STDIN_FILENO, F_SETPIPE_SZ, pipe_size) == -1) {
+        perror("F_SETPIPE_SZ"); // Not a pipe or over the limit, keep going with the default
+    }
+
+    // Aggregation mode counts occurrences of one field per line, fields are 1-based and -k 0 uses the whole line
+    if (key_field >= 0) {
+        agg_init(&agg, key_field, delim);
+    }
+    if (latency_mode) {
+        lat = malloc(sizeof(LatHist));
+        if (lat == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        lat_init(lat);
+    }
+
+    while(1) {
+        linelen = getline(&line, &linecap, stdin);
+        // SIGUSR1 while we were blocked in read() only asks for stats, so report and keep reading
+        if (ferror(stdin) && errno == EINTR && !shutdown_flag) {
+            clearerr(stdin);
+            if (linelen > 0) {
+                // getline hands back the part of the line it already had, hold it until the rest arrives
+                if (piece_len + (size_t)linelen + 1 > piece_cap) {
+                    piece_cap = (piece_len + (size_t)linelen + 1) * 2;
+                    piece = realloc(piece, piece_cap);
+                    if (piece == NULL) {
+                        perror("realloc");
+                        return 1;
+                    }
+                }
+                memcpy(piece + piece_len, line, (size_t)linelen);
+                piece_len += (size_t)linelen;
+            }
+            if (stats_flag) {
+                print_progress(start_clock, line_count, char_count, key_field >= 0 ? &agg : NULL, top_k, lat);
+                stats_flag = 0;
+            }
+            continue;
+        }
+        if (linelen == -1) {
+            if (piece_len == 0) {
+                break;
+            }
+            linelen = 0; // Input ended right after an interrupted line, count what we have
+        }
+        if (piece_len > 0) {
+            // Glue the held start onto the rest and use it as this line, the buffers swap roles
+            if (piece_len + (size_t)linelen + 1 > piece_cap) {
+                piece_cap = piece_len + (size_t)linelen + 1;
+                piece = realloc(piece, piece_cap);
+                if (piece == NULL) {
+                    perror("realloc");
+                    return 1;
+                }
+            }
+            memcpy(piece + piece_len, line, (size_t)linelen);
+            linelen += (ssize_t)piece_len;
+            piece[linelen] = '\0';
+            char *tmp = line;
+            size_t tmp_cap = linecap;
+            line = piece;
+            linecap = piece_cap;
+            piece = tmp;
+            piece_cap = tmp_cap;
+            piece_len = 0;
+        }
 
         // If a shutdown was requested, break out gracefully
         if (shutdown_flag) {
@@ -86,6 +234,12 @@ int main (int argc, char *argv[]){
 
         line_count++;
         char_count += linelen;
+        if (key_field >= 0) {
+            agg_line(&agg, line, (size_t)linelen); // Count this line's key
+        }
+        if (lat != NULL) {
+            record_latency(lat, line, &bad_stamps);
+        }
 
         // If verbose, echo lines to stdout
         if(verbose) {
@@ -100,14 +254,7 @@ int main (int argc, char *argv[]){
 
         // If user requested stats print (SIGUSR1), print current stats to stderr
         if (stats_flag) {
-            clock_t now = clock();
-            double elapsed = ((double)(now - start_clock)) / CLOCKS_PER_SEC;
-            if (elapsed <= 0.0) elapsed = 1e-9;
-            double lines_per_sec = (double)line_count / elapsed;
-            double bytes_per_sec = (double)char_count / elapsed;
-            double mbps = (double)char_count / 1024.0 / 1024.0 / elapsed;
-            fprintf(stderr, "[consumer SIGUSR1] lines: %lld bytes: %lld time(s): %.6f lines/s: %.6f bytes/s: %.6f MB/s: %.6f\n",
-                    line_count, char_count, elapsed, lines_per_sec, bytes_per_sec, mbps);
+            print_progress(start_clock, line_count, char_count, key_field >= 0 ? &agg : NULL, top_k, lat);
             stats_flag = 0;
         }
     }
@@ -130,6 +277,21 @@ int main (int argc, char *argv[]){
     fprintf(stderr, "Bytes/s: %.6f\n", bytes_per_sec);
     fprintf(stderr, "Throughput (MB/s): %.6f\n", mbps);
 
+    // Top keys go to stdout so they can be piped on, the summary joins the other stats
+    if (key_field >= 0) {
+        agg_top(&agg, (size_t)top_k, stdout);
+        fprintf(stderr, "Distinct keys: %zu\n", agg.used);
+        fprintf(stderr, "Lines without field %d: %lld\n", key_field, agg.missing);
+        agg_free(&agg);
+    }
+
+    if (lat != NULL) {
+        lat_print(lat, "", stderr);
+        fprintf(stderr, "Lines without timestamp: %lld\n", bad_stamps);
+        free(lat);
+    }
+
     free(line);
+    free(piece);
     return 0; // Signal success
 }
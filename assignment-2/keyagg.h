@@ -0,0 +1,273 @@
+#ifndef KEYAGG_H
+#define KEYAGG_H
+
+// Streaming per-key counts for consumer.c and consumer_sig.c (the "sort | uniq -c" replacement)
+// Lines are split in place, keys are copied once into a bump arena, counts live in an open-addressing table
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CHUNK (1 << 20) // Default arena chunk, bigger keys get a chunk of their own
+#define AGG_INITIAL_SLOTS 4096 // Power of two
+
+// One arena allocation, chunks are chained and only freed all together
+typedef struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t used;
+	size_t cap;
+	char data[];
+} ArenaChunk;
+
+// One table slot, 32 bytes. hash == 0 marks an empty slot, real hashes are forced nonzero
+typedef struct {
+	uint64_t hash;
+	const char *key; // Points into the arena, not NUL terminated
+	uint32_t len;
+	uint64_t count;
+} AggEntry;
+
+typedef struct {
+	AggEntry *slots;
+	size_t cap; // Power of two
+	size_t used; // Distinct keys
+	ArenaChunk *arena; // Newest chunk first
+	int field; // 1-based field to count, 0 for the whole line
+	char delim;
+	long long missing; // Lines that have fewer than field fields
+	char *carry; // Start of a line that continues in the next block
+	size_t carry_len, carry_cap;
+} KeyAgg;
+
+// Copies n bytes into the arena and returns the copy
+static inline const char *arena_copy(KeyAgg *a, const char *src, size_t n) {
+	if(a->arena == NULL || a->arena->cap - a->arena->used < n) {
+		size_t cap = n > ARENA_CHUNK ? n : ARENA_CHUNK;
+		ArenaChunk *c = malloc(sizeof(ArenaChunk) + cap);
+		if(c == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		c->next = a->arena;
+		c->used = 0;
+		c->cap = cap;
+		a->arena = c;
+	}
+	char *dst = a->arena->data + a->arena->used;
+	memcpy(dst, src, n);
+	a->arena->used += n;
+	return dst;
+}
+
+// Word-at-a-time multiply/xorshift hash, fast enough not to be the bottleneck at GB/s
+static inline uint64_t agg_hash(const char *p, size_t n) {
+	uint64_t h = 0x9E3779B97F4A7C15ull ^ (n * 0xff51afd7ed558ccdull);
+	uint64_t v;
+	while(n >= 8) {
+		memcpy(&v, p, 8);
+		h = (h ^ v) * 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
+		p += 8;
+		n -= 8;
+	}
+	v = 0;
+	memcpy(&v, p, n);
+	h = (h ^ v) * 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 29;
+	return h ? h : 1;
+}
+
+static inline void agg_init(KeyAgg *a, int field, char delim) {
+	memset(a, 0, sizeof(*a));
+	a->field = field;
+	a->delim = delim;
+	a->cap = AGG_INITIAL_SLOTS;
+	a->slots = calloc(a->cap, sizeof(AggEntry));
+	if(a->slots == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+}
+
+static inline void agg_free(KeyAgg *a) {
+	while(a->arena != NULL) {
+		ArenaChunk *next = a->arena->next;
+		free(a->arena);
+		a->arena = next;
+	}
+	free(a->slots);
+	free(a->carry);
+}
+
+// Doubles the table, rehashing from the stored hashes (keys are never touched)
+static inline void agg_grow(KeyAgg *a) {
+	size_t cap = a->cap * 2;
+	AggEntry *slots = calloc(cap, sizeof(AggEntry));
+	if(slots == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	for(size_t i = 0; i < a->cap; i++) {
+		if(a->slots[i].hash != 0) {
+			size_t j = a->slots[i].hash & (cap - 1);
+			while(slots[j].hash != 0) {
+				j = (j + 1) & (cap - 1);
+			}
+			slots[j] = a->slots[i];
+		}
+	}
+	free(a->slots);
+	a->slots = slots;
+	a->cap = cap;
+}
+
+// Counts one occurrence of key, linear probing
+static inline void agg_add(KeyAgg *a, const char *key, size_t len) {
+	uint64_t h = agg_hash(key, len);
+	size_t i = h & (a->cap - 1);
+	while(a->slots[i].hash != 0) {
+		AggEntry *e = &a->slots[i];
+		if(e->hash == h && e->len == len && memcmp(e->key, key, len) == 0) {
+			e->count++;
+			return;
+		}
+		i = (i + 1) & (a->cap - 1);
+	}
+	a->slots[i].hash = h;
+	a->slots[i].key = arena_copy(a, key, len);
+	a->slots[i].len = (uint32_t)len;
+	a->slots[i].count = 1;
+	a->used++;
+	if(a->used * 10 > a->cap * 7) { // Keep probes short, grow past 70% load
+		agg_grow(a);
+	}
+}
+
+// Finds the key field of a complete line in place and counts it
+static inline void agg_count_line(KeyAgg *a, const char *line, size_t len) {
+	const char *p = line, *end = line + len;
+	if(end > p && end[-1] == '\n') {
+		end--;
+	}
+	if(a->field == 0) {
+		agg_add(a, p, (size_t)(end - p));
+		return;
+	}
+	for(int f = 1; f < a->field; f++) {
+		const char *d = memchr(p, a->delim, (size_t)(end - p));
+		if(d == NULL) {
+			a->missing++;
+			return;
+		}
+		p = d + 1;
+	}
+	const char *e = memchr(p, a->delim, (size_t)(end - p));
+	agg_add(a, p, (size_t)((e ? e : end) - p));
+}
+
+// Feeds one line. A line that was started with agg_partial is completed by this call
+static inline void agg_line(KeyAgg *a, const char *line, size_t len) {
+	if(a->carry_len == 0) {
+		agg_count_line(a, line, len);
+		return;
+	}
+	if(a->carry_len + len > a->carry_cap) {
+		a->carry_cap = (a->carry_len + len) * 2;
+		a->carry = realloc(a->carry, a->carry_cap);
+		if(a->carry == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	memcpy(a->carry + a->carry_len, line, len);
+	agg_count_line(a, a->carry, a->carry_len + len);
+	a->carry_len = 0;
+}
+
+// Holds the start of a line whose end is in the next block (block based readers only)
+static inline void agg_partial(KeyAgg *a, const char *piece, size_t len) {
+	if(a->carry_len + len > a->carry_cap) {
+		a->carry_cap = (a->carry_len + len) * 2;
+		a->carry = realloc(a->carry, a->carry_cap);
+		if(a->carry == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	memcpy(a->carry + a->carry_len, piece, len);
+	a->carry_len += len;
+}
+
+// Counts a last line that had no newline
+static inline void agg_finish(KeyAgg *a) {
+	if(a->carry_len > 0) {
+		agg_count_line(a, a->carry, a->carry_len);
+		a->carry_len = 0;
+	}
+}
+
+// Heap order for agg_top: fewer occurrences first, so the root is the entry to evict
+static inline int agg_less(const AggEntry *x, const AggEntry *y) {
+	return x->count < y->count;
+}
+
+static inline void agg_sift_down(const AggEntry **heap, size_t n, size_t i) {
+	while(1) {
+		size_t l = 2 * i + 1, r = l + 1, m = i;
+		if(l < n && agg_less(heap[l], heap[m])) m = l;
+		if(r < n && agg_less(heap[r], heap[m])) m = r;
+		if(m == i) return;
+		const AggEntry *t = heap[i];
+		heap[i] = heap[m];
+		heap[m] = t;
+		i = m;
+	}
+}
+
+// Prints the k most frequent keys as "count key", most frequent first, like sort | uniq -c | sort -rn | head
+// Uses a size-k min-heap, so it costs O(distinct log k) and can run mid-stream
+static inline void agg_top(const KeyAgg *a, size_t k, FILE *out) {
+	if(k > a->used) {
+		k = a->used;
+	}
+	if(k == 0) {
+		return;
+	}
+	const AggEntry **heap = malloc(k * sizeof(*heap));
+	if(heap == NULL) {
+		perror("malloc");
+		return;
+	}
+	size_t n = 0;
+	for(size_t i = 0; i < a->cap; i++) {
+		const AggEntry *e = &a->slots[i];
+		if(e->hash == 0) {
+			continue;
+		}
+		if(n < k) {
+			heap[n++] = e;
+			if(n == k) {
+				for(size_t j = k / 2; j-- > 0;) {
+					agg_sift_down(heap, k, j);
+				}
+			}
+		} else if(agg_less(heap[0], e)) {
+			heap[0] = e;
+			agg_sift_down(heap, k, 0);
+		}
+	}
+	// Pop the min repeatedly into the back, leaving the array sorted most frequent first
+	for(size_t end = k; end > 1; end--) {
+		const AggEntry *t = heap[0];
+		heap[0] = heap[end - 1];
+		heap[end - 1] = t;
+		agg_sift_down(heap, end - 1, 0);
+	}
+	for(size_t i = 0; i < k; i++) {
+		fprintf(out, "%7llu %.*s\n", (unsigned long long)heap[i]->count, (int)heap[i]->len, heap[i]->key);
+	}
+	free(heap);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+// Fixed-size log-linear latency histogram for consumer_sig.c -L (the HdrHistogram layout, 3 significant bits short)
+// Values below 256 ns get a bucket each, above that every power of two is split into 128 linear buckets,
+// so any recorded value is known to within 1/128 (< 0.8%) from 1 ns up to 2^64 ns in 58 KB, with no allocation
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LAT_SUB_BITS 7 // 2^7 linear buckets per power of two
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_DIRECT (2 * LAT_SUB) // Values below this are stored exactly
+#define LAT_BUCKETS (LAT_DIRECT + (64 - LAT_SUB_BITS - 1) * LAT_SUB) // Exponents LAT_SUB_BITS + 1 .. 63
+
+typedef struct {
+	uint64_t counts[LAT_BUCKETS];
+	uint64_t count;
+	uint64_t min, max;
+	double sum; // For the mean, a uint64_t of ns sums would overflow after a few hours at high rates
+} LatHist;
+
+static inline void lat_init(LatHist *h) {
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+// Bucket of value v: exact below LAT_DIRECT, otherwise exponent and top LAT_SUB_BITS + 1 bits
+static inline size_t lat_index(uint64_t v) {
+	if(v < LAT_DIRECT) {
+		return (size_t)v;
+	}
+	int e = 63 - __builtin_clzll(v); // e >= LAT_SUB_BITS + 1
+	uint64_t top = v >> (e - LAT_SUB_BITS); // In [LAT_SUB, 2 * LAT_SUB)
+	return LAT_DIRECT + (size_t)(e - LAT_SUB_BITS - 1) * LAT_SUB + (size_t)(top - LAT_SUB);
+}
+
+// Largest value that lands in bucket i, what a percentile falling in that bucket is reported as
+static inline uint64_t lat_bucket_max(size_t i) {
+	if(i < LAT_DIRECT) {
+		return i;
+	}
+	int e = (int)((i - LAT_DIRECT) / LAT_SUB) + LAT_SUB_BITS + 1;
+	uint64_t top = (i - LAT_DIRECT) % LAT_SUB + LAT_SUB;
+	int shift = e - LAT_SUB_BITS;
+	return (top << shift) + ((1ull << shift) - 1);
+}
+
+static inline void lat_record(LatHist *h, uint64_t v) {
+	h->counts[lat_index(v)]++;
+	h->count++;
+	h->sum += (double)v;
+	if(v < h->min) h->min = v;
+	if(v > h->max) h->max = v;
+}
+
+// Value at percentile p (0-100]: the upper edge of the bucket holding the ceil(p% * count)-th smallest value
+static inline uint64_t lat_percentile(const LatHist *h, double p) {
+	if(h->count == 0) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t)(p / 100.0 * (double)h->count + 0.999999);
+	if(rank == 0) rank = 1;
+	uint64_t seen = 0;
+	for(size_t i = 0; i < LAT_BUCKETS; i++) {
+		seen += h->counts[i];
+		if(seen >= rank) {
+			uint64_t v = lat_bucket_max(i);
+			return v > h->max ? h->max : v; // Never report past the largest value actually seen
+		}
+	}
+	return h->max;
+}
+
+// One-line summary in microseconds, prefix tells a SIGUSR1 snapshot from the final report
+static inline void lat_print(const LatHist *h, const char *prefix, FILE *out) {
+	if(h->count == 0) {
+		fprintf(out, "%slatency: no samples\n", prefix);
+		return;
+	}
+	fprintf(out, "%slatency (us): n=%llu min=%.2f mean=%.2f p50=%.2f p90=%.2f p99=%.2f p99.9=%.2f p99.99=%.2f max=%.2f\n",
+		prefix, (unsigned long long)h->count, (double)h->min / 1e3, h->sum / (double)h->count / 1e3,
+		(double)lat_percentile(h, 50) / 1e3, (double)lat_percentile(h, 90) / 1e3,
+		(double)lat_percentile(h, 99) / 1e3, (double)lat_percentile(h, 99.9) / 1e3,
+		(double)lat_percentile(h, 99.99) / 1e3, (double)h->max / 1e3);
+}
+
+#endif
@@ -0,0 +1,370 @@
+#define _GNU_SOURCE // struct rusage from wait4
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// Runs "producer -f file -b buf [-p pipe] | consumer" itself over a grid of settings and reports,
+// per run: wall-clock MB/s and lines/s, read+write syscalls per MB and CPU seconds for each side
+// With -u every setting is also run with both sides on io_uring (-u) and the speedup is shown
+
+#define MAX_VALUES 16 // Longest list accepted for one swept setting
+
+// One side of the pipeline after it exited
+typedef struct {
+	double cpu; // User + system seconds
+	long long syscalls; // read + write syscalls (syscr + syscw from /proc/<pid>/io)
+	int status; // Wait status
+} SideStats;
+
+// Wall clock in seconds
+double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Parses a byte count with an optional K, M or G suffix
+long long parse_size(const char *s) {
+	char *end;
+	long long v = strtoll(s, &end, 10);
+	switch(*end) {
+		case 'k': case 'K': v <<= 10; end++; break;
+		case 'm': case 'M': v <<= 20; end++; break;
+		case 'g': case 'G': v <<= 30; end++; break;
+	}
+	if(*end != '\0' || v < 0) {
+		return -1;
+	}
+	return v;
+}
+
+// Parses a comma separated list of sizes into values, returns how many or -1 on a bad entry
+int parse_list(const char *arg, long long *values) {
+	char *copy = strdup(arg);
+	int n = 0;
+	for(char *tok = strtok(copy, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		if(n == MAX_VALUES || (values[n] = parse_size(tok)) == -1) {
+			free(copy);
+			return -1;
+		}
+		n++;
+	}
+	free(copy);
+	return n;
+}
+
+// Writes size bytes of line_len-byte lines (newline included) to a new temp file and returns its path
+char *make_input(long long size, long long line_len) {
+	const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	char *path = malloc(strlen(dir) + 32);
+	if(path == NULL) {
+		perror("malloc");
+		return NULL;
+	}
+	sprintf(path, "%s/pipeline_bench.XXXXXX", dir);
+	int fd = mkstemp(path);
+	if(fd == -1) {
+		perror("mkstemp");
+		free(path);
+		return NULL;
+	}
+
+	// Fill a 1 MB block with whole lines and write it repeatedly, the final block cut to size
+	size_t block = 1 << 20;
+	char *buf = malloc(block);
+	if(buf == NULL) {
+		perror("malloc");
+		close(fd);
+		unlink(path);
+		free(path);
+		return NULL;
+	}
+	for(size_t i = 0; i < block; i++) {
+		buf[i] = (i % (size_t)line_len == (size_t)line_len - 1) ? '\n' : (char)('a' + i % 26);
+	}
+	size_t whole = block - block % (size_t)line_len; // Keep lines intact across blocks
+	if(whole == 0) {
+		whole = block;
+	}
+	long long left = size;
+	while(left > 0) {
+		size_t n = (size_t)left < whole ? (size_t)left : whole;
+		if(write(fd, buf, n) != (ssize_t)n) {
+			perror("write");
+			close(fd);
+			unlink(path);
+			free(buf);
+			free(path);
+			return NULL;
+		}
+		left -= (long long)n;
+	}
+	free(buf);
+	close(fd);
+	return path;
+}
+
+// Reads syscr + syscw of an exited but not yet reaped child
+long long read_syscalls(pid_t pid) {
+	char path[64], line[128];
+	long long total = 0, v;
+	snprintf(path, sizeof(path), "/proc/%d/io", pid);
+	FILE *f = fopen(path, "r");
+	if(f == NULL) {
+		return -1;
+	}
+	while(fgets(line, sizeof(line), f) != NULL) {
+		if(sscanf(line, "syscr: %lld", &v) == 1 || sscanf(line, "syscw: %lld", &v) == 1) {
+			total += v;
+		}
+	}
+	fclose(f);
+	return total;
+}
+
+// Waits for pid, grabbing its syscall counters before reaping it
+void collect(pid_t pid, SideStats *st) {
+	siginfo_t si;
+	struct rusage ru;
+	while(waitid(P_PID, (id_t)pid, &si, WEXITED | WNOWAIT) == -1 && errno == EINTR) {
+	}
+	st->syscalls = read_syscalls(pid);
+	wait4(pid, &st->status, 0, &ru);
+	st->cpu = (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1e6 +
+	          (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1e6;
+}
+
+// Runs one producer | consumer pipeline. Returns wall seconds, or -1 if either side failed
+double run_pipeline(const char *producer, const char *consumer, const char *input,
+                    long long buf_size, long long pipe_size, int uring, SideStats *prod, SideStats *cons) {
+	int fds[2];
+	char buf_arg[32], pipe_arg[32];
+	char *pargv[10], *cargv[3];
+	int pn = 0, cn = 0;
+	snprintf(buf_arg, sizeof(buf_arg), "%lld", buf_size);
+	snprintf(pipe_arg, sizeof(pipe_arg), "%lld", pipe_size);
+
+	pargv[pn++] = (char *)producer;
+	pargv[pn++] = "-f";
+	pargv[pn++] = (char *)input;
+	pargv[pn++] = "-b";
+	pargv[pn++] = buf_arg;
+	if(pipe_size > 0) {
+		pargv[pn++] = "-p";
+		pargv[pn++] = pipe_arg;
+	}
+	cargv[cn++] = (char *)consumer;
+	if(uring) {
+		pargv[pn++] = "-u";
+		cargv[cn++] = "-u";
+	}
+	pargv[pn] = NULL;
+	cargv[cn] = NULL;
+
+	if(pipe(fds) == -1) {
+		perror("pipe");
+		return -1;
+	}
+	double start = now_sec();
+
+	pid_t p = fork();
+	if(p == -1) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if(p == 0) {
+		dup2(fds[1], STDOUT_FILENO); // Producer writes into the pipe
+		close(fds[0]);
+		close(fds[1]);
+		execv(producer, pargv);
+		perror(producer);
+		_exit(127);
+	}
+
+	pid_t c = fork();
+	if(c == -1) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		waitpid(p, NULL, 0);
+		return -1;
+	}
+	if(c == 0) {
+		dup2(fds[0], STDIN_FILENO); // Consumer reads from the pipe
+		close(fds[0]);
+		close(fds[1]);
+		int devnull = open("/dev/null", O_WRONLY);
+		if(devnull != -1) {
+			dup2(devnull, STDERR_FILENO); // Its own statistics would clutter the table
+			close(devnull);
+		}
+		execv(consumer, cargv);
+		_exit(127);
+	}
+
+	close(fds[0]); // Only the children may hold the pipe, or the consumer never sees EOF
+	close(fds[1]);
+	collect(p, prod);
+	collect(c, cons);
+	double elapsed = now_sec() - start;
+
+	if(!WIFEXITED(prod->status) || WEXITSTATUS(prod->status) != 0 ||
+	   !WIFEXITED(cons->status) || WEXITSTATUS(cons->status) != 0) {
+		fprintf(stderr, "Pipeline failed (buffer %lld, pipe %lld): producer status %d, consumer status %d\n",
+			buf_size, pipe_size, prod->status, cons->status);
+		return -1;
+	}
+	return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+	const char *producer = "./producer";
+	const char *consumer = "./consumer";
+	long long bufs[MAX_VALUES] = { 4096, 65536, 1048576 };
+	long long pipes[MAX_VALUES] = { 0, 65536, 1048576 };
+	long long lines[MAX_VALUES] = { 16, 128, 1024 };
+	long long inputs[MAX_VALUES] = { 64LL << 20 };
+	int nbufs = 3, npipes = 3, nlines = 3, ninputs = 1;
+	int repeats = 3;
+	int with_uring = 0; // Also run every setting on the io_uring backend
+
+	// Extra variables
+	int getopt_ret;
+	char opt;
+
+	while((getopt_ret = getopt(argc, argv, "P:C:b:p:l:i:r:uh")) != -1) {
+		opt = (char)getopt_ret;
+		switch(opt) {
+			case 'P': // Producer binary
+				producer = optarg;
+				break;
+			case 'C': // Consumer binary
+				consumer = optarg;
+				break;
+			case 'b': // Producer buffer sizes
+				nbufs = parse_list(optarg, bufs);
+				break;
+			case 'p': // Pipe capacities, 0 means kernel default
+				npipes = parse_list(optarg, pipes);
+				break;
+			case 'l': // Line lengths including the newline
+				nlines = parse_list(optarg, lines);
+				break;
+			case 'i': // Input sizes
+				ninputs = parse_list(optarg, inputs);
+				break;
+			case 'r': // Runs per setting, the fastest is reported
+				repeats = atoi(optarg);
+				break;
+			case 'u': // Compare with io_uring
+				with_uring = 1;
+				break;
+			case 'h': // Help
+			default:
+				fprintf(stderr, "Usage: %s [-P producer] [-C consumer] [-b buf,...] [-p pipe,...] [-l line_len,...] [-i input_size,...] [-r repeats] [-u]\n"
+					"Sizes take K, M or G suffixes. Pipe size 0 keeps the kernel default.\n", argv[0]);
+				return 1;
+		}
+		if(nbufs <= 0 || npipes <= 0 || nlines <= 0 || ninputs <= 0 || repeats <= 0) {
+			fprintf(stderr, "Invalid value for -%c: %s\n", opt, optarg);
+			return 1;
+		}
+	}
+	for(int i = 0; i < nbufs; i++) {
+		if(bufs[i] <= 0) {
+			fprintf(stderr, "Buffer sizes must be positive\n");
+			return 1;
+		}
+	}
+	for(int i = 0; i < npipes; i++) {
+		if(pipes[i] < 0) {
+			fprintf(stderr, "Pipe sizes must be positive, or 0 for the kernel default\n");
+			return 1;
+		}
+	}
+	for(int i = 0; i < nlines; i++) {
+		if(lines[i] <= 0) {
+			fprintf(stderr, "Line lengths must be positive\n");
+			return 1;
+		}
+	}
+	for(int i = 0; i < ninputs; i++) {
+		if(inputs[i] <= 0) {
+			fprintf(stderr, "Input sizes must be positive\n");
+			return 1;
+		}
+	}
+
+	printf("%8s %8s %6s %8s %-8s %10s %12s %10s %10s %9s %9s %6s\n",
+		"buffer", "pipe", "line", "input", "io", "MB/s", "lines/s", "prod sc/MB", "cons sc/MB", "prod cpu", "cons cpu", "gain");
+	for(int ii = 0; ii < ninputs; ii++) {
+		for(int li = 0; li < nlines; li++) {
+			char *input = make_input(inputs[ii], lines[li]);
+			if(input == NULL) {
+				return 1;
+			}
+			double mb = (double)inputs[ii] / 1024.0 / 1024.0;
+			double nlines_in = (double)((inputs[ii] + lines[li] - 1) / lines[li]);
+
+			for(int bi = 0; bi < nbufs; bi++) {
+				for(int pi = 0; pi < npipes; pi++) {
+					char pipe_label[24];
+					if(pipes[pi] > 0) {
+						snprintf(pipe_label, sizeof(pipe_label), "%lld", pipes[pi]);
+					} else {
+						snprintf(pipe_label, sizeof(pipe_label), "default");
+					}
+
+					double blocking_best = 0;
+					for(int uring = 0; uring <= with_uring; uring++) {
+						double best = -1;
+						SideStats bp = {0}, bc = {0};
+						for(int r = 0; r < repeats; r++) {
+							SideStats sp, sc;
+							double t = run_pipeline(producer, consumer, input, bufs[bi], pipes[pi], uring, &sp, &sc);
+							if(t < 0) {
+								unlink(input);
+								free(input);
+								return 1;
+							}
+							if(best < 0 || t < best) {
+								best = t;
+								bp = sp;
+								bc = sc;
+							}
+						}
+						char gain[16] = "";
+						if(uring) {
+							snprintf(gain, sizeof(gain), "x%.2f", blocking_best / best); // Speedup over the blocking run above
+						} else {
+							blocking_best = best;
+						}
+						char prod_sc[16] = "n/a", cons_sc[16] = "n/a"; // /proc/<pid>/io may be unreadable
+						if(bp.syscalls >= 0) {
+							snprintf(prod_sc, sizeof(prod_sc), "%.1f", (double)bp.syscalls / mb);
+						}
+						if(bc.syscalls >= 0) {
+							snprintf(cons_sc, sizeof(cons_sc), "%.1f", (double)bc.syscalls / mb);
+						}
+						printf("%8lld %8s %6lld %8lld %-8s %10.1f %12.0f %10s %10s %9.3f %9.3f %6s\n",
+							bufs[bi], pipe_label, lines[li], inputs[ii], uring ? "io_uring" : "blocking",
+							mb / best, nlines_in / best, prod_sc, cons_sc, bp.cpu, bc.cpu, gain);
+						fflush(stdout);
+					}
+				}
+			}
+			unlink(input);
+			free(input);
+		}
+	}
+	return 0; // Signal success
+}
@@ -1,12 +1,278 @@
+#define _GNU_SOURCE // F_SETPIPE_SZ
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <signal.h>
+#include "uring.h"
+
+#define URING_DEPTH 8 // Registered buffers in the io_uring path, i.e. reads that can be in flight at once
+
+// States of one buffer in the io_uring copy loop
+#define SLOT_FREE 0
+#define SLOT_READING 1
+#define SLOT_FULL 2 // Read finished, waiting for its turn to be written
+#define SLOT_WRITING 3
+
+typedef struct {
+	int state; // SLOT_*
+	long long seq; // Block number, blocks are written strictly in this order
+	uint64_t off; // File offset of the block (seekable input only)
+	size_t len; // Bytes read into buf
+	size_t written; // Bytes of len already written
+	char *buf;
+} Slot;
+
+// Queues a read that fills the rest of slot i
+int queue_read(Uring *ring, Slot *s, int i, int fd, int seekable, int fixed, size_t buffer_size) {
+	uint64_t off = seekable ? s->off + s->len : (uint64_t)-1; // -1 reads from the current position of a pipe
+	return uring_queue_rw(ring, 0, fd, s->buf + s->len, (unsigned)(buffer_size - s->len), off, fixed ? i : -1, (uint64_t)i);
+}
+
+// Queues a write of whatever slot i still has to write
+int queue_write(Uring *ring, Slot *s, int i, int fd, int fixed) {
+	return uring_queue_rw(ring, 1, fd, s->buf + s->written, (unsigned)(s->len - s->written), (uint64_t)-1, fixed ? i : -1, (uint64_t)i);
+}
+
+// io_uring copy loop: keeps up to URING_DEPTH reads in flight while finished blocks are written to out_fd in order
+// Returns 0 on success, 1 on an I/O error, -1 (errno set) if io_uring is unavailable and nothing was copied
+int copy_uring(int in_fd, int out_fd, size_t buffer_size) {
+	Uring ring;
+	Slot slots[URING_DEPTH];
+	struct iovec iov[URING_DEPTH];
+	struct stat st;
+
+	if(uring_init(&ring, URING_DEPTH * 2) == -1) {
+		return -1;
+	}
+	// A regular file can be read at explicit offsets, so all reads can be in flight at once
+	// Concurrent reads on a pipe could complete out of order, so there only one is, overlapped with the write
+	int seekable = fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode);
+	int max_reads = seekable ? URING_DEPTH : 1;
+	uint64_t next_off = seekable ? (uint64_t)lseek(in_fd, 0, SEEK_CUR) : 0;
+
+	char *mem = malloc(URING_DEPTH * buffer_size);
+	if(mem == NULL) {
+		perror("malloc");
+		uring_exit(&ring);
+		return 1;
+	}
+	for(int i = 0; i < URING_DEPTH; i++) {
+		memset(&slots[i], 0, sizeof(slots[i]));
+		slots[i].buf = mem + (size_t)i * buffer_size;
+		iov[i].iov_base = slots[i].buf;
+		iov[i].iov_len = buffer_size;
+	}
+	int fixed = uring_register_buffers(&ring, iov, URING_DEPTH) == 0; // Plain READ/WRITE still work if pinning is refused
+
+	long long next_read = 0, next_write = 0;
+	int reading = 0, writing = 0, eof = 0, failed = 0;
+	while(1) {
+		// Keep the read queue full
+		for(int i = 0; i < URING_DEPTH && !eof && !failed && reading < max_reads; i++) {
+			if(slots[i].state != SLOT_FREE) {
+				continue;
+			}
+			slots[i].state = SLOT_READING;
+			slots[i].seq = next_read++;
+			slots[i].off = next_off;
+			slots[i].len = 0;
+			slots[i].written = 0;
+			next_off += buffer_size;
+			queue_read(&ring, &slots[i], i, in_fd, seekable, fixed, buffer_size);
+			reading++;
+		}
+
+		// Start the next block's write once the previous one is done
+		for(int i = 0; i < URING_DEPTH && !writing && !failed; i++) {
+			if(slots[i].state == SLOT_FULL && slots[i].seq == next_write) {
+				slots[i].state = SLOT_WRITING;
+				queue_write(&ring, &slots[i], i, out_fd, fixed);
+				writing = 1;
+			}
+		}
+
+		if(reading == 0 && writing == 0) {
+			break; // Input exhausted and every block written (or gave up after an error)
+		}
+
+		if(uring_submit_and_wait(&ring, 1) == -1) {
+			perror("io_uring_enter");
+			uring_exit(&ring);
+			return 1; // Requests may still own the buffers, so mem is left for process exit to reclaim
+		}
+
+		struct io_uring_cqe *cqe;
+		while((cqe = uring_peek(&ring)) != NULL) {
+			int i = (int)cqe->user_data;
+			int res = cqe->res;
+			Slot *s = &slots[i];
+			uring_seen(&ring);
+
+			if(s->state == SLOT_READING) {
+				reading--;
+				if(res < 0) {
+					errno = -res;
+					perror("io_uring read");
+					failed = 1;
+					s->state = SLOT_FREE;
+				} else if(res == 0) {
+					eof = 1;
+					s->state = s->len > 0 ? SLOT_FULL : SLOT_FREE;
+				} else {
+					s->len += (size_t)res;
+					if(seekable && s->len < buffer_size && !failed) {
+						queue_read(&ring, s, i, in_fd, seekable, fixed, buffer_size); // Short read, top the block up
+						reading++;
+					} else {
+						s->state = SLOT_FULL;
+					}
+				}
+			} else {
+				writing = 0;
+				if(res <= 0) {
+					errno = res < 0 ? -res : EIO;
+					perror("io_uring write");
+					failed = 1;
+					s->state = SLOT_FREE;
+					continue;
+				}
+				s->written += (size_t)res;
+				if(s->written < s->len && !failed) {
+					queue_write(&ring, s, i, out_fd, fixed); // Short write into a full pipe
+					writing = 1;
+				} else {
+					s->state = SLOT_FREE;
+					next_write++;
+				}
+			}
+		}
+	}
+
+	uring_exit(&ring);
+	free(mem);
+	return failed ? 1 : 0;
+}
+
+volatile sig_atomic_t stop_flag = 0; // Set by SIGINT in paced mode
+
+// Handler for SIGINT, lets an unbounded paced run stop and still report
+void handle_sigint(int sig) {
+	(void)sig;
+	stop_flag = 1;
+}
+
+// Monotonic clock in nanoseconds, comparable across processes on the same machine
+uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Paced mode: emits count records (0 = until the reader goes away) at rate records/s
+// Each record is one record_len-byte line "<send_ns> <seq> xxx...\n" for consumer_sig -L
+// Open loop: record i is due at start + i/rate no matter how long earlier writes blocked, and by default is
+// stamped with that due time, so a backed-up pipe shows up as latency instead of silently lowering the rate
+// (coordinated omission). stamp_actual stamps the real write time instead, to see the difference
+int produce_paced(double rate, long long count, int record_len, size_t buffer_size, int stamp_actual) {
+	double period = 1e9 / rate;
+	size_t batch_max = buffer_size / (size_t)record_len; // Records due at once are written with one write()
+	if(batch_max == 0) {
+		batch_max = 1;
+	}
+	char *batch = malloc(batch_max * (size_t)record_len);
+	if(batch == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	uint64_t start = now_ns();
+	uint64_t max_lag = 0; // Furthest we fell behind the schedule
+	uint64_t last_write = start; // When the latest batch finished writing
+	long long i = 0;
+	while((count == 0 || i < count) && !stop_flag) {
+		uint64_t now = now_ns();
+		uint64_t due_at = start + (uint64_t)((double)i * period);
+		if(now < due_at) {
+			struct timespec ts = { (time_t)(due_at / 1000000000ull), (long)(due_at % 1000000000ull) };
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+			continue;
+		}
+		if(now - due_at > max_lag) {
+			max_lag = now - due_at;
+		}
+
+		// Everything that is due by now goes out in one batch
+		long long due = (long long)((double)(now - start) / period) + 1;
+		if(count != 0 && due > count) {
+			due = count;
+		}
+		size_t n = 0;
+		char *p = batch;
+		for(; i < due && n < batch_max; i++, n++) {
+			uint64_t stamp = stamp_actual ? now : start + (uint64_t)((double)i * period);
+			int hdr = snprintf(p, (size_t)record_len, "%llu %lld ", (unsigned long long)stamp, i);
+			if(hdr >= record_len) {
+				hdr = record_len - 1; // Header was truncated, the consumer only needs the stamp
+			}
+			memset(p + hdr, 'x', (size_t)(record_len - 1 - hdr));
+			p[record_len - 1] = '\n';
+			p += record_len;
+		}
+
+		size_t len = n * (size_t)record_len, off = 0;
+		while(off < len) {
+			ssize_t w = write(STDOUT_FILENO, batch + off, len - off);
+			if(w == -1) {
+				if(errno == EINTR) {
+					if(stop_flag) {
+						break;
+					}
+					continue;
+				}
+				if(errno != EPIPE) {
+					perror("write");
+				}
+				break; // Reader is gone, stop here
+			}
+			off += (size_t)w;
+		}
+		if(off < len) {
+			i -= (long long)((len - off + (size_t)record_len - 1) / (size_t)record_len); // Not (fully) written
+			if(off >= (size_t)record_len) {
+				last_write = now_ns(); // The whole records that did get out still belong in the span
+			}
+			break;
+		}
+		last_write = now_ns();
+	}
+
+	double elapsed = (double)(now_ns() - start) / 1e9;
+	// The first record goes out at start, so i records span i - 1 periods up to the last write
+	double span = (double)(last_write - start) / 1e9;
+	double achieved = i > 1 && span > 0 ? (double)(i - 1) / span : 0;
+	fprintf(stderr, "Records: %lld\n", i);
+	fprintf(stderr, "Time (sec): %.6f\n", elapsed);
+	fprintf(stderr, "Achieved rate (records/s): %.2f (target %.2f)\n", achieved, rate);
+	fprintf(stderr, "Max lag behind schedule (us): %.2f\n", (double)max_lag / 1e3);
+	free(batch);
+	return 0;
+}
 
 int main(int argc, char *argv[]) {
 	FILE *input = stdin;
 	int buffer_size = 4096;
+	int pipe_size = 0; // 0 keeps the kernel's default pipe capacity
+	int use_uring = 0;
+	double rate = 0; // Records per second in paced mode, 0 copies input as fast as possible
+	long long count = 0; // Records to send in paced mode, 0 = unlimited
+	int record_len = 64; // Bytes per paced record, newline included
+	int stamp_actual = 0;
 	char opt;
 
 	// Extra varibles
@@ -19,7 +285,7 @@ int main(int argc, char *argv[]) {
 	// -f filename ( optional )
 	// -b buffer_size ( optional )
 
-	while((getopt_ret = getopt(argc, argv, "f:b:vh")) != -1) {
+	while((getopt_ret = getopt(argc, argv, "f:b:p:ur:c:l:avh")) != -1) {
 		opt = (char)getopt_ret;
 		switch(opt) {
 			case 'f': // Input file
@@ -32,15 +298,56 @@ int main(int argc, char *argv[]) {
 					return 1;
 				}
 				break;
+			case 'p': // Pipe capacity
+				pipe_size = atoi(optarg);
+				if(pipe_size <= 0){
+					fprintf(stderr, "Invalid pipe size: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'u': // io_uring backend
+				use_uring = 1;
+				break;
+			case 'r': // Paced mode rate
+				rate = atof(optarg);
+				if(rate <= 0){
+					fprintf(stderr, "Invalid rate: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'c': // Paced record count
+				count = atoll(optarg);
+				if(count < 0){
+					fprintf(stderr, "Invalid count: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'l': // Paced record length
+				record_len = atoi(optarg);
+				if(record_len < 24){
+					fprintf(stderr, "Invalid record length: %s (at least 24)\n", optarg);
+					return 1;
+				}
+				break;
+			case 'a': // Stamp actual send time
+				stamp_actual = 1;
+				break;
 			case 'v': // Verbose but it's not used here
 				break;
 			case 'h': // Help
 			default:
-				fprintf(stderr, "Usage: %s [-f file] [-b size]\n", argv[0]);
+				fprintf(stderr, "Usage: %s [-f file] [-b size] [-p pipe_size] [-u]\n"
+					"       %s -r rate [-c count] [-l record_len] [-a] [-b size] [-p pipe_size]\n"
+					"Paced mode (-r) generates its own records and writes them with write(), so it takes neither -f nor -u.\n", argv[0], argv[0]);
 				return 1;
 		}
 	}
 
+	if(rate > 0 && (use_uring || filename != NULL)) {
+		fprintf(stderr, "-r cannot be combined with -f or -u\n");
+		return 1;
+	}
+
 	// TODO : Open file if -f provided
 
 	if(filename != NULL) {
@@ -51,6 +358,36 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	// Grow the pipe we write into, so fewer context switches are needed per MB
+	// The kernel rounds up to a power of two pages and caps unprivileged users at /proc/sys/fs/pipe-max-size
+	if(pipe_size > 0 && fcntl(STDOUT_FILENO, F_SETPIPE_SZ, pipe_size) == -1) {
+		perror("F_SETPIPE_SZ"); // Not a pipe or over the limit, keep going with the default
+	}
+
+	// Paced mode generates timestamped records instead of copying input
+	if(rate > 0) {
+		if(input != stdin) fclose(input);
+		signal(SIGPIPE, SIG_IGN); // A reader that goes away shows up as EPIPE, so the summary still prints
+		struct sigaction sa;
+		sa.sa_handler = handle_sigint;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = 0; // No SA_RESTART, Ctrl-C must cut a sleep or a blocked write short
+		if(sigaction(SIGINT, &sa, NULL) == -1) {
+			perror("sigaction(SIGINT)");
+		}
+		return produce_paced(rate, count, record_len, (size_t)buffer_size, stamp_actual);
+	}
+
+	// Overlapped io_uring path, falls back to the blocking loop below if the kernel doesn't offer it
+	if(use_uring) {
+		int rc = copy_uring(fileno(input), STDOUT_FILENO, (size_t)buffer_size);
+		if(rc != -1) {
+			if(input != stdin) fclose(input); // Close input file if opened
+			return rc;
+		}
+		fprintf(stderr, "io_uring unavailable (%s), using blocking I/O\n", strerror(errno));
+	}
+
 	// TODO : Allocate buffer
 
 	buffer = (char*)malloc((size_t)buffer_size); // Buffer is allocated
@@ -0,0 +1,151 @@
+#ifndef URING_H
+#define URING_H
+
+// Minimal io_uring wrapper on the raw syscalls (no liburing), shared by producer.c and consumer.c
+// Only what a single-threaded copy loop needs: setup, registered buffers, queue SQEs, submit/wait, reap CQEs
+
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+typedef struct {
+	int fd; // Ring fd from io_uring_setup
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array; // Submission queue, shared with the kernel
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head, *cq_tail, *cq_mask; // Completion queue, shared with the kernel
+	struct io_uring_cqe *cqes;
+	void *sq_ptr, *cq_ptr; // Mappings, cq_ptr == sq_ptr with IORING_FEAT_SINGLE_MMAP
+	size_t sq_len, cq_len, sqes_len;
+	unsigned queued; // SQEs filled in but not yet passed to io_uring_enter
+} Uring;
+
+// Sets up a ring with room for entries requests. Returns 0, or -1 with errno set (ENOSYS/EPERM when unavailable)
+static inline int uring_init(Uring *r, unsigned entries) {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	memset(r, 0, sizeof(*r));
+	r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if(r->fd < 0) {
+		return -1;
+	}
+
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(r->cq_len > r->sq_len) {
+			r->sq_len = r->cq_len;
+		}
+		r->cq_len = r->sq_len;
+	}
+	r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if(r->sq_ptr == MAP_FAILED) {
+		close(r->fd);
+		return -1;
+	}
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ptr = r->sq_ptr;
+	} else {
+		r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if(r->cq_ptr == MAP_FAILED) {
+			munmap(r->sq_ptr, r->sq_len);
+			close(r->fd);
+			return -1;
+		}
+	}
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if(r->sqes == MAP_FAILED) {
+		if(r->cq_ptr != r->sq_ptr) {
+			munmap(r->cq_ptr, r->cq_len);
+		}
+		munmap(r->sq_ptr, r->sq_len);
+		close(r->fd);
+		return -1;
+	}
+
+	char *sq = r->sq_ptr, *cq = r->cq_ptr;
+	r->sq_head = (unsigned *)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+static inline void uring_exit(Uring *r) {
+	munmap(r->sqes, r->sqes_len);
+	if(r->cq_ptr != r->sq_ptr) {
+		munmap(r->cq_ptr, r->cq_len);
+	}
+	munmap(r->sq_ptr, r->sq_len);
+	close(r->fd);
+}
+
+// Pins n buffers so READ_FIXED/WRITE_FIXED skip the per-request page lookup
+static inline int uring_register_buffers(Uring *r, const struct iovec *iov, unsigned n) {
+	return (int)syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, n);
+}
+
+// Queues one read or write. off -1 means the file's current position (pipes, or sequential stdout)
+// buf_index >= 0 selects a registered buffer and turns the request into READ_FIXED/WRITE_FIXED
+// Returns -1 if the submission queue is full
+static inline int uring_queue_rw(Uring *r, int write, int fd, void *buf, unsigned len, uint64_t off, int buf_index, uint64_t user_data) {
+	unsigned tail = *r->sq_tail;
+	if(tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) > *r->sq_mask) {
+		return -1;
+	}
+	unsigned idx = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	if(buf_index >= 0) {
+		sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->buf_index = (uint16_t)buf_index;
+	} else {
+		sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	}
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = user_data;
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE); // Kernel may read the SQE once the tail moves
+	r->queued++;
+	return 0;
+}
+
+// Hands queued SQEs to the kernel and blocks until at least wait_nr completions are ready
+static inline int uring_submit_and_wait(Uring *r, unsigned wait_nr) {
+	int ret;
+	do {
+		ret = (int)syscall(__NR_io_uring_enter, r->fd, r->queued, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while(ret == -1 && errno == EINTR);
+	if(ret >= 0) {
+		r->queued -= (unsigned)ret < r->queued ? (unsigned)ret : r->queued;
+	}
+	return ret;
+}
+
+// Returns the oldest unreaped completion, or NULL when there is none
+static inline struct io_uring_cqe *uring_peek(Uring *r) {
+	unsigned head = *r->cq_head;
+	if(head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+	return &r->cqes[head & *r->cq_mask];
+}
+
+// Releases the completion returned by uring_peek
+static inline void uring_seen(Uring *r) {
+	__atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
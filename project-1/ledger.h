@@ -0,0 +1,201 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+// Append-only transaction history for one account, used by phase2.c and phase4.c
+// Records live in fixed-size columnar chunks (one array per field), and each chunk's first timestamp
+// forms a sparse time index, so a statement between T1 and T2 is two binary searches plus a scan of the match
+// Appends happen while the teller already holds the account's lock, so they need no lock of their own:
+// a few stores and one release store publishing the new count. Statements read lock-free alongside them
+// Tellers call ledger_reserve before taking the lock, so the next chunk is allocated before it is needed
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LEDGER_CHUNK 1024 // Records per chunk, power of two
+#define LEDGER_MAX_CHUNKS 4096 // Chunk directory size, so up to 4M records per account
+
+// What happened to the account
+typedef enum {
+	TX_DEPOSIT,
+	TX_WITHDRAW,
+	TX_TRANSFER_IN,
+	TX_TRANSFER_OUT
+} TxType;
+
+// LEDGER_CHUNK records stored column by column, a statement's time search only touches ts
+typedef struct {
+	uint64_t ts[LEDGER_CHUNK]; // Wall clock in ns, non-decreasing within an account
+	double amount[LEDGER_CHUNK];
+	double balance[LEDGER_CHUNK]; // Balance right after the transaction
+	int32_t counterparty[LEDGER_CHUNK]; // Other account of a transfer, -1 otherwise
+	int16_t teller[LEDGER_CHUNK];
+	uint8_t type[LEDGER_CHUNK]; // TxType
+} LedgerChunk;
+
+typedef struct {
+	LedgerChunk *chunks[LEDGER_MAX_CHUNKS]; // Fixed directory, never moves under a reader
+	uint64_t first_ts[LEDGER_MAX_CHUNKS]; // Sparse index: timestamp of each chunk's first record
+	LedgerChunk *spare; // Next chunk, filled by ledger_reserve outside the lock and taken by ledger_append
+	size_t count; // Published records, written with release and read with acquire
+	uint64_t last_ts;
+	long long dropped; // Records lost because the directory was full, accessed atomically
+} Ledger;
+
+// Wall clock in ns
+static inline uint64_t ledger_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline LedgerChunk *ledger_chunk_alloc(void) {
+	LedgerChunk *c = malloc(sizeof(LedgerChunk));
+	if(c == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	return c;
+}
+
+static inline void ledger_init(Ledger *l) {
+	for(int i = 0; i < LEDGER_MAX_CHUNKS; i++) {
+		l->chunks[i] = NULL;
+	}
+	l->chunks[0] = ledger_chunk_alloc();
+	l->spare = ledger_chunk_alloc();
+	l->count = 0;
+	l->last_ts = 0;
+	l->dropped = 0;
+}
+
+// Makes sure a spare chunk is ready. Call it before locking the account, so ledger_append never mallocs under the lock
+// Tellers may race here: the loser frees its chunk. An atomic load is all it costs while a spare is waiting
+static inline void ledger_reserve(Ledger *l) {
+	if(__atomic_load_n(&l->spare, __ATOMIC_ACQUIRE) != NULL) {
+		return;
+	}
+	if(__atomic_load_n(&l->count, __ATOMIC_ACQUIRE) / LEDGER_CHUNK + 1 >= LEDGER_MAX_CHUNKS) {
+		return; // Directory is about to be full, nothing left to take a spare
+	}
+	LedgerChunk *c = ledger_chunk_alloc();
+	LedgerChunk *expected = NULL;
+	if(!__atomic_compare_exchange_n(&l->spare, &expected, c, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		free(c); // Another teller got there first
+	}
+}
+
+static inline void ledger_free(Ledger *l) {
+	for(int i = 0; i < LEDGER_MAX_CHUNKS && l->chunks[i] != NULL; i++) {
+		free(l->chunks[i]);
+	}
+	free(l->spare);
+}
+
+// Appends one record. The caller must hold the account's lock (one writer per ledger at a time)
+static inline void ledger_append(Ledger *l, uint64_t ts, TxType type, double amount, double balance, int counterparty, int teller_id) {
+	size_t n = l->count; // Only writers change count and we are the only writer right now
+	size_t ci = n / LEDGER_CHUNK, i = n % LEDGER_CHUNK;
+	if(ci == LEDGER_MAX_CHUNKS) {
+		__atomic_fetch_add(&l->dropped, 1, __ATOMIC_RELAXED); // Statements read it without the lock
+		return;
+	}
+	if(i == 0 && l->chunks[ci] == NULL) {
+		// Previous chunk is full, take the spare. Only a teller that skipped ledger_reserve ends up allocating here
+		LedgerChunk *c = __atomic_exchange_n(&l->spare, NULL, __ATOMIC_ACQUIRE);
+		l->chunks[ci] = c != NULL ? c : ledger_chunk_alloc();
+	}
+	if(ts < l->last_ts) {
+		ts = l->last_ts; // Keep the column sorted if the wall clock steps back
+	}
+	l->last_ts = ts;
+
+	LedgerChunk *c = l->chunks[ci];
+	c->ts[i] = ts;
+	c->amount[i] = amount;
+	c->balance[i] = balance;
+	c->counterparty[i] = counterparty;
+	c->teller[i] = (int16_t)teller_id;
+	c->type[i] = (uint8_t)type;
+	if(i == 0) {
+		l->first_ts[ci] = ts;
+	}
+	__atomic_store_n(&l->count, n + 1, __ATOMIC_RELEASE); // Record is complete before readers can see it
+}
+
+// Index of the first record with ts >= t among the first n records
+static inline size_t ledger_lower_bound(const Ledger *l, size_t n, uint64_t t) {
+	if(n == 0) {
+		return 0;
+	}
+	// Sparse index: the last chunk starting before t is the only one that can hold the boundary
+	size_t chunks = (n + LEDGER_CHUNK - 1) / LEDGER_CHUNK;
+	size_t lo = 0, hi = chunks;
+	while(lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if(l->first_ts[mid] < t) lo = mid + 1;
+		else hi = mid;
+	}
+	if(lo == 0) {
+		return 0;
+	}
+	size_t ci = lo - 1;
+
+	// Then binary search that chunk's timestamp column
+	const LedgerChunk *c = l->chunks[ci];
+	size_t end = n - ci * LEDGER_CHUNK < LEDGER_CHUNK ? n - ci * LEDGER_CHUNK : LEDGER_CHUNK;
+	lo = 0;
+	hi = end;
+	while(lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if(c->ts[mid] < t) lo = mid + 1;
+		else hi = mid;
+	}
+	return ci * LEDGER_CHUNK + lo;
+}
+
+static inline const char *tx_name(uint8_t type) {
+	switch(type) {
+		case TX_DEPOSIT: return "deposit";
+		case TX_WITHDRAW: return "withdraw";
+		case TX_TRANSFER_IN: return "transfer in";
+		case TX_TRANSFER_OUT: return "transfer out";
+	}
+	return "?";
+}
+
+// Prints every record of account_id with t1 <= ts <= t2 and returns how many there were
+// Safe to call while tellers are still appending, it sees the records published when it started
+static inline size_t ledger_statement(const Ledger *l, int account_id, uint64_t t1, uint64_t t2, FILE *out) {
+	size_t n = __atomic_load_n(&l->count, __ATOMIC_ACQUIRE);
+	size_t printed = 0;
+	fprintf(out, "Statement for Account %d:\n", account_id);
+	for(size_t k = ledger_lower_bound(l, n, t1); k < n; k++) {
+		const LedgerChunk *c = l->chunks[k / LEDGER_CHUNK];
+		size_t i = k % LEDGER_CHUNK;
+		if(c->ts[i] > t2) {
+			break; // Sorted, so nothing later can match
+		}
+		time_t sec = (time_t)(c->ts[i] / 1000000000ull);
+		struct tm tm;
+		char when[16];
+		localtime_r(&sec, &tm);
+		strftime(when, sizeof(when), "%H:%M:%S", &tm);
+		fprintf(out, "  %s.%06llu  teller %d  %-12s %10.2f", when,
+			(unsigned long long)(c->ts[i] % 1000000000ull / 1000), c->teller[i], tx_name(c->type[i]), c->amount[i]);
+		if(c->counterparty[i] >= 0) {
+			fprintf(out, "  %s Account %d", c->type[i] == TX_TRANSFER_IN ? "from" : "to", c->counterparty[i]);
+		}
+		fprintf(out, "  balance %.2f\n", c->balance[i]);
+		printed++;
+	}
+	long long dropped = __atomic_load_n(&l->dropped, __ATOMIC_RELAXED);
+	if(dropped > 0) {
+		fprintf(out, "  (%lld records dropped, history full)\n", dropped);
+	}
+	return printed;
+}
+
+#endif
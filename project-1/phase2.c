@@ -5,6 +5,7 @@
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include "ledger.h"
 
 #define NUM_ACCOUNTS 1 // Number of bank accounts
 #define NUM_THREADS 3 // Number of threads
@@ -17,6 +18,7 @@ typedef struct {
 	double balance; // Current balance for the account
 	int transaction_count; // Total number of transactions performed
 	pthread_mutex_t lock; // Mutex lock for synchronizing access
+	Ledger history; // Every transaction on this account, appended under lock
 } Account;
 
 // Global accounts array (shared resource)
@@ -26,22 +28,26 @@ pthread_t threads[NUM_THREADS]; // Array that holds teller handles
 int thread_ids[NUM_THREADS]; // Array that holds teller IDs
 
 // Deposit function (protected transaction)
-void deposit(int account_id, double amount) {
+void deposit(int account_id, double amount, int teller_id) {
+	ledger_reserve(&accounts[account_id].history); // Any chunk allocation happens here, before the lock
 	pthread_mutex_lock(&accounts[account_id].lock); // Lock before modifying
 	double temp = accounts[account_id].balance;
         usleep(rand() % 10000); // Random short deley, but this time it won't increase any chances of race condition
         accounts[account_id].balance = temp + amount; // Add amount to balance
         accounts[account_id].transaction_count++; // Up transaction count by 1
+        ledger_append(&accounts[account_id].history, ledger_now(), TX_DEPOSIT, amount, accounts[account_id].balance, -1, teller_id); // Record it while we still hold the lock
 	pthread_mutex_unlock(&accounts[account_id].lock); // Unlock after modifying
 }
 
 // Withdraw function (protected transaction)
-void withdraw(int account_id, double amount) {
+void withdraw(int account_id, double amount, int teller_id) {
+	ledger_reserve(&accounts[account_id].history); // Any chunk allocation happens here, before the lock
 	pthread_mutex_lock(&accounts[account_id].lock); // Lock before modifying
         double temp = accounts[account_id].balance;
         usleep(rand() % 10000); // Random short deley, but this time it won't i>
         accounts[account_id].balance = temp - amount; // Add amount to balance
         accounts[account_id].transaction_count++; // Up transaction count by 1
+        ledger_append(&accounts[account_id].history, ledger_now(), TX_WITHDRAW, amount, accounts[account_id].balance, -1, teller_id); // Record it while we still hold the lock
         pthread_mutex_unlock(&accounts[account_id].lock); // Unlock after modifying
 }
 
@@ -55,11 +61,11 @@ void* teller_thread(void* arg) {
 		if(teller_id == 1 || teller_id == 2){ // Teller 1 and 2 always deposits
 			double amount = 100.0;
 			printf("Thread %d: Depositing %.2f\n", teller_id, amount); // Let user know
-			deposit(0, amount); // Deposit into Account 0
+			deposit(0, amount, teller_id); // Deposit into Account 0
 		} else{ // Teller 3 always withdraws
 			double amount = 50.0;
 			printf("Thread %d: Withdrawing %.2f\n", teller_id, amount); //  Let user know
-			withdraw(0, amount); // Withdraw from Account 0
+			withdraw(0, amount, teller_id); // Withdraw from Account 0
 		}
 	}
 
@@ -73,8 +79,10 @@ int main(void) {
 	accounts[0].balance = INITIAL_BALANCE;
 	accounts[0].transaction_count = 0;
 	pthread_mutex_init(&accounts[0].lock, NULL); // Initialize mutex
+	ledger_init(&accounts[0].history); // Empty history
 
 	printf("Intial balance: %.2f\n", accounts[0].balance);
+	uint64_t start_ts = ledger_now(); // Statement window starts here
 
 	//Create teller threads
 	for (int i = 0; i < NUM_THREADS; i++) {
@@ -93,7 +101,19 @@ int main(void) {
 	// Print final balance after all transactions
 	printf("Final balance: %.2f\n", accounts[0].balance);
 
+	// Print the account's history for the whole run
+	size_t shown = ledger_statement(&accounts[0].history, 0, start_ts, ledger_now(), stdout);
+	printf("%zu of %d transactions shown\n", shown, accounts[0].transaction_count);
+
+	// And just the middle third of the run, found through the time index rather than by scanning from the start
+	uint64_t end_ts = ledger_now();
+	uint64_t third = (end_ts - start_ts) / 3;
+	printf("Middle third of the run:\n");
+	shown = ledger_statement(&accounts[0].history, 0, start_ts + third, end_ts - third, stdout);
+	printf("%zu transactions shown\n", shown);
+
 	// Destroy mutex to clean up resources
 	pthread_mutex_destroy(&accounts[0].lock);
+	ledger_free(&accounts[0].history);
 	return 0;
 }
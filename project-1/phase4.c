@@ -5,6 +5,7 @@
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include "ledger.h"
 
 #define NUM_ACCOUNTS 2 // Number of bank accounts
 #define NUM_THREADS 2 // Number of threads
@@ -16,6 +17,7 @@ typedef struct {
 	double balance; // Current balance for the account
 	int transaction_count; // Total number of transactions performed
 	pthread_mutex_t lock; // Mutex lock for synchronizing access
+	Ledger history; // Every transaction on this account, appended under lock
 } Account;
 
 // Global accounts array (shared resource)
@@ -45,6 +47,10 @@ int try_lock_with_timeout(pthread_mutex_t *lock, int milliseconds) {
 // safe_transfer function to safely transfer money between two accounts without deadlock
 void safe_transfer(int from_id, int to_id, double amount, int teller_id) {
 	while(1){ // Keep running until the transfer succeeds
+		// Have both histories' next chunks ready before any lock is held
+		ledger_reserve(&accounts[from_id].history);
+		ledger_reserve(&accounts[to_id].history);
+
 		// Lock source account first
 		if(pthread_mutex_lock(&accounts[from_id].lock) != 0) {
 			continue; // If this lock fails then we retry
@@ -56,6 +62,13 @@ void safe_transfer(int from_id, int to_id, double amount, int teller_id) {
 			// Perform transfer
 			accounts[from_id].balance -= amount;
 			accounts[to_id].balance += amount;
+			accounts[from_id].transaction_count++;
+			accounts[to_id].transaction_count++;
+
+			// Record both sides with one timestamp while both locks are still held
+			uint64_t now = ledger_now();
+			ledger_append(&accounts[from_id].history, now, TX_TRANSFER_OUT, amount, accounts[from_id].balance, to_id, teller_id);
+			ledger_append(&accounts[to_id].history, now, TX_TRANSFER_IN, amount, accounts[to_id].balance, from_id, teller_id);
 
 			// Release locks in reverse order
 			pthread_mutex_unlock(&accounts[to_id].lock);
@@ -99,7 +112,9 @@ int main(void) {
 		accounts[i].balance = INITIAL_BALANCE;
 		accounts[i].transaction_count = 0;
 		pthread_mutex_init(&accounts[i].lock, NULL);
+		ledger_init(&accounts[i].history);
 	}
+	uint64_t start_ts = ledger_now(); // Statement window starts here
 
 	// Assign teller IDs
 	thread_ids[0] = 1;
@@ -118,9 +133,16 @@ int main(void) {
 	printf("Final balances: Account 0 = %.2f & Account 1 = %.2f\n",
 		accounts[0].balance, accounts[1].balance);
 
+	// Print each account's history for the whole run
+	uint64_t end_ts = ledger_now();
+	for(int i = 0; i < NUM_ACCOUNTS; i++) {
+		ledger_statement(&accounts[i].history, i, start_ts, end_ts, stdout);
+	}
+
 	// Destroy mutex to clean up resources
 	for (int i = 0; i < NUM_ACCOUNTS; i++) {
 		pthread_mutex_destroy(&accounts[i].lock);
+		ledger_free(&accounts[i].history);
 	}
 
 	return 0;